@@ -0,0 +1,145 @@
+//-- db work per action over a matrix of pools x holders per pool x bookings
+//--
+//-- usage: modihost_bench [pools holders bookings]
+//-- without arguments it runs the default matrix, one line per scenario and action:
+//-- calls, failed calls, mean and max db reads (find, get, lower_bound, iterator steps) and
+//-- writes (emplace, modify, erase) of one call
+
+#include "harness.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+using namespace harness;
+
+namespace {
+
+   struct actionstats {
+      uint32_t calls = 0;
+      uint32_t failed = 0;
+      uint64_t reads = 0;
+      uint64_t writes = 0;
+      uint64_t maxReads = 0;
+      uint64_t maxWrites = 0;
+      std::string firstError;
+
+      void add(const dbwork& work)
+      {
+         calls++;
+         reads += work.reads;
+         writes += work.writes;
+         maxReads = std::max(maxReads, work.reads);
+         maxWrites = std::max(maxWrites, work.writes);
+
+         if (work.failed) {
+            if (failed == 0) {
+               firstError = work.error;
+            }
+            failed++;
+         }
+      }
+   };
+
+   //-- actions in the order the scenario runs them
+   struct report {
+      std::vector<std::string> order;
+      std::map<std::string, actionstats> actions;
+
+      template<typename F>
+      void run(const std::string& action, F f)
+      {
+         if (actions.find(action) == actions.end()) {
+            order.push_back(action);
+         }
+         actions[action].add(measure(f));
+      }
+   };
+
+   void scenario(const uint32_t pools, const uint32_t holders, const uint32_t bookings)
+   {
+      chainspec spec;
+      spec.pools = pools;
+      spec.holders = holders;
+      spec.deposit = 1000;
+      chain(spec);
+
+      auto c = modihost();
+      report rep;
+
+      //-- bookings take about three quarters of the pools' tokens, so later ones walk drained pools
+      const int64_t liquidity = int64_t{pools} * holders * spec.deposit;
+      const int64_t perBooking = std::max<int64_t>(1, liquidity * 3 / 4 / bookings);
+
+      for (uint32_t k = 0; k < bookings; k++) {
+         auto hotel = hotelacnt(k % spec.hotels);
+         auth({ hotel });
+         rep.run("reqservice", [&] { c.reqservice(k + 1, hotel, tokens(perBooking)); });
+      }
+
+      //-- past every pool lock, the unlock runs until no lock row is left
+      g_now += 100000;
+
+      for (uint32_t i = 0; i < 1000; i++) {
+         token::pooltknlocks poolLocks(N("aim"), N("aim").value);
+         token::hldrtknlocks hldrLocks(N("aim"), N("aim").value);
+
+         if (poolLocks.begin() == poolLocks.end() && hldrLocks.begin() == hldrLocks.end()) {
+            break;
+         }
+
+         auth({ N("aim") });
+         rep.run("unlkpooltkns", [&] { c.unlkpooltkns(100); });
+      }
+
+      for (uint32_t p = 0; p < pools; p++) {
+         auth({ collacnt(p) });
+         rep.run("payrewards", [&] { c.payrewards(poolacnt(p), collacnt(p), 0, holders); });
+      }
+
+      //-- half of the holders leave, the pools are terminated with the rest still in
+      for (uint32_t p = 0; p < pools; p++) {
+         for (uint32_t h = 0; h < holders / 2; h++) {
+            auth({ hldracnt(p, h) });
+            rep.run("leavepool", [&] { c.leavepool(poolacnt(p), hldracnt(p, h)); });
+         }
+      }
+
+      for (uint32_t p = 0; p < pools; p++) {
+         auth({ collacnt(p) });
+         rep.run("trminatepool", [&] { c.trminatepool(poolacnt(p), holders); });
+      }
+
+      for (const auto& action : rep.order) {
+         const auto& s = rep.actions[action];
+
+         std::printf("%6u %8u %9u  %-13s %6u %6u %10.1f %8llu %10.1f %8llu  %s\n",
+                     pools, holders, bookings, action.c_str(), s.calls, s.failed,
+                     double(s.reads) / s.calls, (unsigned long long)s.maxReads,
+                     double(s.writes) / s.calls, (unsigned long long)s.maxWrites,
+                     s.firstError.c_str());
+      }
+   }
+
+} //-- end of namespace
+
+int main(int argc, char** argv)
+{
+   std::printf("%6s %8s %9s  %-13s %6s %6s %10s %8s %10s %8s  %s\n",
+               "pools", "holders", "bookings", "action", "calls", "failed", "reads", "max", "writes", "max", "first error");
+
+   if (argc == 4) {
+      scenario(std::atoi(argv[1]), std::atoi(argv[2]), std::atoi(argv[3]));
+      return 0;
+   }
+
+   for (uint32_t pools : { 4, 16, 64 }) {
+      for (uint32_t holders : { 4, 16, 64 }) {
+         for (uint32_t bookings : { 16, 256 }) {
+            scenario(pools, holders, bookings);
+         }
+      }
+   }
+
+   return 0;
+}
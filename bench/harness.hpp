@@ -0,0 +1,187 @@
+#pragma once
+
+//-- native harness for the modihost contract, builds src/modihost.cpp against the eosio stand-ins in mock/
+//-- so actions run as plain calls on in-memory tables, see README.md
+
+//-- the table typedefs and helpers the harness inspects are private to the contract
+#define private public
+#include <modihost.hpp>
+#undef private
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace harness {
+
+   using namespace eosio;
+
+   inline const symbol AIM = symbol(symbol_code("AIM"), 4);
+
+   inline name N(const std::string& s) { return name(std::string_view(s)); }
+   inline asset tokens(const int64_t units) { return asset(units * 10000, AIM); }
+   inline token modihost() { return token(N("aim"), N("aim"), 0); }
+
+   //-- the accounts that signed the next action
+   inline void auth(std::initializer_list<name> accounts)
+   {
+      g_env.auths.clear();
+      for (auto a : accounts) {
+         g_env.auths.insert(a.value);
+      }
+   }
+
+   //-- raw balance of owner, -1 without a balance row
+   inline int64_t balance(const name owner)
+   {
+      token::accounts acnts(N("aim"), owner.value);
+      auto itr = acnts.find(AIM.code().raw());
+      return itr == acnts.end() ? -1 : itr->balance.amount;
+   }
+
+   //-- i in three letters, unique for i < 17576
+   inline std::string letters(const uint32_t i)
+   {
+      return { char('a' + (i / 676) % 26), char('a' + (i / 26) % 26), char('a' + i % 26) };
+   }
+
+   inline name poolacnt(uint32_t i) { return N("pool" + letters(i)); }
+   inline name collacnt(uint32_t i) { return N("coll" + letters(i)); }
+   inline name rwdacnt(uint32_t i) { return N("rwd" + letters(i)); }
+   inline name hldracnt(uint32_t pool, uint32_t i) { return N("h" + letters(pool) + letters(i)); }
+   inline name hotelacnt(uint32_t i) { return N("hotel" + letters(i)); }
+
+   inline void newaccount(const name a)
+   {
+      g_env.accounts.insert(a.value);
+   }
+
+   //-- empty chain: no tables, accounts or deferred transactions, clock and db counters reset
+   inline void reset()
+   {
+      mock_reset_tables();
+      g_env = mock_env{};
+      g_deferred.clear();
+      g_db = dbstats{};
+      g_now = 1700000000;
+   }
+
+   struct chainspec {
+      uint32_t pools = 3;
+      uint32_t holders = 2; // per pool
+      int64_t deposit = 1000; // tokens each holder lends to its pool
+      uint32_t hotels = 2;
+      int64_t mainpoolTokens = 1000000;
+   };
+
+   //-- token created, main pool initialized, `pools` pools with rewards 100, 110, ... bps and
+   //-- `holders` holders each, every hotel holds 100000 tokens
+   inline void chain(const chainspec& spec)
+   {
+      reset();
+
+      for (auto a : { "aim", "escrow1.aim", "escrow2.aim", "escrow3.aim", "escrow4.aim", "mainpool.aim" }) {
+         newaccount(N(a));
+      }
+
+      auto c = modihost();
+      auth({ N("aim") });
+      c.create(N("aim"), asset(int64_t{10000000000} * 10000, AIM));
+      c.issue(N("aim"), asset(int64_t{10000000000} * 10000, AIM), "");
+
+      if (spec.mainpoolTokens > 0) {
+         c.transfer(N("aim"), N("mainpool.aim"), tokens(spec.mainpoolTokens), "");
+      }
+      else {
+         c.open(N("mainpool.aim"), AIM, N("aim"));
+      }
+
+      for (uint32_t i = 0; i < spec.hotels; i++) {
+         newaccount(hotelacnt(i));
+         c.transfer(N("aim"), hotelacnt(i), tokens(100000), "");
+      }
+
+      c.initialize();
+
+      for (uint32_t p = 0; p < spec.pools; p++) {
+         newaccount(poolacnt(p));
+         newaccount(collacnt(p));
+         newaccount(rwdacnt(p));
+
+         auth({ N("aim") });
+         c.transfer(N("aim"), collacnt(p), tokens(200000), "");
+         c.addpool(poolacnt(p), collacnt(p), collacnt(p), rwdacnt(p), 100 + 10 * p, false, 2000, 8000, tokens(150000), {});
+
+         for (uint32_t h = 0; h < spec.holders; h++) {
+            auto holder = hldracnt(p, h);
+            newaccount(holder);
+
+            auth({ N("aim") });
+            c.transfer(N("aim"), holder, tokens(spec.deposit), "");
+
+            auth({ holder });
+            c.addpoolholdr(poolacnt(p), holder, tokens(spec.deposit));
+         }
+      }
+
+      auth({});
+   }
+
+   //-- sum of every balance row the chain spec creates, equals the supply while no tokens are lost
+   inline int64_t totalbalances(const chainspec& spec)
+   {
+      int64_t total = 0;
+      std::vector<name> acnts;
+
+      for (auto a : { "aim", "escrow1.aim", "escrow2.aim", "escrow3.aim", "escrow4.aim", "mainpool.aim" }) {
+         acnts.push_back(N(a));
+      }
+      for (uint32_t i = 0; i < spec.hotels; i++) {
+         acnts.push_back(hotelacnt(i));
+      }
+      for (uint32_t p = 0; p < spec.pools; p++) {
+         acnts.push_back(poolacnt(p));
+         acnts.push_back(collacnt(p));
+         acnts.push_back(rwdacnt(p));
+
+         for (uint32_t h = 0; h < spec.holders; h++) {
+            acnts.push_back(hldracnt(p, h));
+         }
+      }
+
+      for (auto a : acnts) {
+         auto b = balance(a);
+         total += b > 0 ? b : 0;
+      }
+      return total;
+   }
+
+   //-- db calls one action made
+   struct dbwork {
+      uint64_t reads = 0;
+      uint64_t writes = 0;
+      bool failed = false;
+      std::string error;
+   };
+
+   template<typename F>
+   dbwork measure(F f)
+   {
+      dbwork work;
+      auto before = g_db;
+
+      try {
+         f();
+      }
+      catch (const assert_failure& e) {
+         work.failed = true;
+         work.error = e.what();
+      }
+
+      work.reads = g_db.reads() - before.reads();
+      work.writes = g_db.writes() - before.writes();
+      return work;
+   }
+
+} //-- end of namespace harness
@@ -0,0 +1,47 @@
+#pragma once
+#include "name.hpp"
+#include "check.hpp"
+#include <set>
+#include <vector>
+#include <string>
+#include <tuple>
+#include <functional>
+namespace eosio {
+struct permission_level {
+   name actor; name permission;
+   permission_level() = default;
+   permission_level(name a, name p) : actor(a), permission(p) {}
+};
+struct mock_env {
+   std::set<uint64_t> accounts;
+   std::set<uint64_t> auths;
+   std::vector<uint64_t> recipients;
+   std::vector<std::string> inline_actions;
+   std::vector<std::function<void()>> inline_thunks;
+};
+extern mock_env g_env;
+inline void require_auth(name n) { check(g_env.auths.count(n.value) > 0, "missing required authority " + n.to_string()); }
+inline bool has_auth(name n) { return g_env.auths.count(n.value) > 0; }
+inline bool is_account(name n) { return g_env.accounts.count(n.value) > 0; }
+inline void require_recipient(name n) { g_env.recipients.push_back(n.value); }
+template <typename... Ns> void require_recipient(name n, Ns... ns) { require_recipient(n); require_recipient(ns...); }
+struct action {
+   std::vector<permission_level> authorization;
+   name account; name act;
+   std::function<void()> thunk;
+   action() = default;
+   template <typename T>
+   action(const permission_level& auth, name a, name n, T&&) : authorization{auth}, account(a), act(n) {}
+   template <typename T>
+   action(const std::vector<permission_level>& auth, name a, name n, T&&) : authorization(auth), account(a), act(n) {}
+   void send() const { g_env.inline_actions.push_back(act.to_string()); }
+};
+template <name::raw Name, auto... Actions>
+struct action_wrapper {
+   name code; std::vector<permission_level> perms;
+   action_wrapper(name c, const permission_level& p) : code(c), perms{p} {}
+   action_wrapper(name c, const std::vector<permission_level>& p) : code(c), perms(p) {}
+   template <typename... Args> void send(Args&&...) const { g_env.inline_actions.push_back(name(Name).to_string()); }
+   template <typename... Args> action to_action(Args&&...) const { return action(perms[0], code, name(Name), std::make_tuple()); }
+};
+}
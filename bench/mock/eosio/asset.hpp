@@ -0,0 +1,56 @@
+#pragma once
+#include "name.hpp"
+#include "check.hpp"
+#include <cstdint>
+#include <string>
+namespace eosio {
+class symbol_code {
+ public:
+   constexpr symbol_code() : value(0) {}
+   constexpr explicit symbol_code(uint64_t raw) : value(raw) {}
+   constexpr explicit symbol_code(std::string_view str) : value(0) {
+      for (auto itr = str.rbegin(); itr != str.rend(); ++itr) { value <<= 8; value |= *itr; }
+   }
+   constexpr uint64_t raw() const { return value; }
+   constexpr bool is_valid() const { return value != 0; }
+   std::string to_string() const { std::string s; uint64_t v = value; while (v) { s += char(v & 0xff); v >>= 8; } return s; }
+   friend constexpr bool operator==(const symbol_code& a, const symbol_code& b) { return a.value == b.value; }
+   friend constexpr bool operator!=(const symbol_code& a, const symbol_code& b) { return a.value != b.value; }
+ private:
+   uint64_t value;
+};
+class symbol {
+ public:
+   constexpr symbol() : value(0) {}
+   constexpr explicit symbol(uint64_t raw) : value(raw) {}
+   constexpr symbol(symbol_code sc, uint8_t precision) : value((sc.raw() << 8) | (uint64_t)precision) {}
+   constexpr bool is_valid() const { return code().is_valid(); }
+   constexpr uint8_t precision() const { return (uint8_t)(value & 0xFF); }
+   constexpr symbol_code code() const { return symbol_code{value >> 8}; }
+   constexpr uint64_t raw() const { return value; }
+   friend constexpr bool operator==(const symbol& a, const symbol& b) { return a.value == b.value; }
+   friend constexpr bool operator!=(const symbol& a, const symbol& b) { return a.value != b.value; }
+ private:
+   uint64_t value;
+};
+struct asset {
+   int64_t amount = 0;
+   eosio::symbol symbol;
+   static constexpr int64_t max_amount = (1LL << 62) - 1;
+   asset() {}
+   asset(int64_t a, class symbol s) : amount(a), symbol(s) { check(is_amount_within_range(), "magnitude of asset amount must be less than 2^62"); }
+   bool is_amount_within_range() const { return -max_amount <= amount && amount <= max_amount; }
+   bool is_valid() const { return is_amount_within_range() && symbol.is_valid(); }
+   asset operator-() const { asset r = *this; r.amount = -r.amount; return r; }
+   asset& operator-=(const asset& a) { check(a.symbol == symbol, "attempt to subtract asset with different symbol"); amount -= a.amount; check(-max_amount <= amount, "subtraction underflow"); check(amount <= max_amount, "subtraction overflow"); return *this; }
+   asset& operator+=(const asset& a) { check(a.symbol == symbol, "attempt to add asset with different symbol"); amount += a.amount; check(-max_amount <= amount, "addition underflow"); check(amount <= max_amount, "addition overflow"); return *this; }
+   friend asset operator+(const asset& a, const asset& b) { asset r = a; r += b; return r; }
+   friend asset operator-(const asset& a, const asset& b) { asset r = a; r -= b; return r; }
+   asset& operator*=(int64_t a) { amount *= a; return *this; }
+   friend asset operator*(const asset& a, int64_t b) { asset r = a; r *= b; return r; }
+   friend bool operator==(const asset& a, const asset& b) { return a.symbol == b.symbol && a.amount == b.amount; }
+   friend bool operator!=(const asset& a, const asset& b) { return !(a == b); }
+   friend bool operator<(const asset& a, const asset& b) { return a.amount < b.amount; }
+   std::string to_string() const { return std::to_string(amount) + " " + symbol.code().to_string(); }
+};
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <optional>
+namespace eosio {
+template <typename T>
+class binary_extension {
+ public:
+   binary_extension() = default;
+   binary_extension(const T& v) : _v(v) {}
+   bool has_value() const { return _v.has_value(); }
+   const T& value() const { return *_v; }
+   T value_or(const T& d = T()) const { return _v ? *_v : d; }
+   T& operator*() { return *_v; }
+   const T& operator*() const { return *_v; }
+   binary_extension& operator=(const T& v) { _v = v; return *this; }
+   void emplace(const T& v) { _v = v; }
+ private:
+   std::optional<T> _v;
+};
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+#include <iostream>
+namespace eosio {
+struct assert_failure : std::runtime_error { using std::runtime_error::runtime_error; };
+inline void check(bool pred, const char* msg) { if (!pred) throw assert_failure(msg); }
+inline void check(bool pred, const std::string& msg) { if (!pred) throw assert_failure(msg); }
+extern bool g_print;
+inline void print_one(const char* s) { if (g_print) std::cout << s; }
+inline void print_one(const std::string& s) { if (g_print) std::cout << s; }
+template <typename T> auto print_one(const T& v) -> decltype(v.to_string(), void()) { if (g_print) std::cout << v.to_string(); }
+template <typename T> auto print_one(const T& v) -> decltype(std::cout << v, void()) { if (g_print) std::cout << v; }
+inline void print_one(unsigned __int128 v) { if (g_print) std::cout << (unsigned long long)v; }
+template <typename... Ts> void print(const Ts&... ts) { (print_one(ts), ...); }
+}
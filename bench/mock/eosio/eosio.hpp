@@ -0,0 +1,23 @@
+#pragma once
+
+//-- stand-ins for the eosio.cdt headers the contract includes, just enough to run its actions natively
+//-- from the harness in bench/, see bench/README.md
+#include "name.hpp"
+#include "check.hpp"
+#include "action.hpp"
+#include "multi_index.hpp"
+#include "system.hpp"
+#include <string>
+#include <vector>
+namespace eosio {
+static constexpr name same_payer{};
+class contract {
+ public:
+   contract(name self, name first_receiver, int /*ds*/) : _self(self), _first_receiver(first_receiver) {}
+   name get_self() const { return _self; }
+   name get_first_receiver() const { return _first_receiver; }
+ protected:
+   name _self;
+   name _first_receiver;
+};
+}
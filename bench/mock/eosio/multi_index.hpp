@@ -0,0 +1,212 @@
+#pragma once
+#include "name.hpp"
+#include "check.hpp"
+#include <map>
+#include <tuple>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include <functional>
+
+//-- in-memory multi_index for the native harness, rows live in one map per (code, scope, table)
+//-- and every db call is counted in g_db
+namespace eosio {
+struct dbstats {
+   uint64_t finds = 0, gets = 0, emplaces = 0, modifies = 0, erases = 0, nexts = 0, idxseeks = 0;
+   uint64_t reads() const { return finds + gets + nexts + idxseeks; }
+   uint64_t writes() const { return emplaces + modifies + erases; }
+};
+extern dbstats g_db;
+
+//-- clears every table ever opened, for harness runs that start from an empty chain
+std::vector<std::function<void()>>& mock_resets();
+inline void mock_reset_tables() { for (auto& r : mock_resets()) r(); }
+
+template <typename T>
+std::map<std::tuple<uint64_t, uint64_t, uint64_t>, std::map<uint64_t, T>>& mock_store() {
+   static std::map<std::tuple<uint64_t, uint64_t, uint64_t>, std::map<uint64_t, T>> s;
+   static bool registered = (mock_resets().push_back([] { s.clear(); }), true);
+   (void)registered;
+   return s;
+}
+
+template <class Class, class Type, Type (Class::*PtrToMemberFunction)() const>
+struct const_mem_fun {
+   typedef typename std::remove_reference<Type>::type result_type;
+   Type operator()(const Class& x) const { return (x.*PtrToMemberFunction)(); }
+};
+
+template <name::raw IndexName, typename Extractor>
+struct indexed_by {
+   static constexpr name::raw index_name = IndexName;
+   typedef Extractor secondary_extractor_type;
+};
+
+template <name::raw TableName, typename T, typename... Indices>
+class multi_index {
+ public:
+   using rows_t = std::map<uint64_t, T>;
+   rows_t* rows;
+   name _code; uint64_t _scope;
+
+   multi_index(name code, uint64_t scope) : _code(code), _scope(scope) {
+      rows = &mock_store<T>()[std::make_tuple(code.value, scope, (uint64_t)TableName)];
+   }
+   name get_code() const { return _code; }
+   uint64_t get_scope() const { return _scope; }
+
+   struct const_iterator {
+      const rows_t* rows = nullptr;
+      typename rows_t::const_iterator it;
+      const T& operator*() const { check(it != rows->end(), "cannot dereference end iterator"); return it->second; }
+      const T* operator->() const { check(it != rows->end(), "cannot dereference end iterator"); return &it->second; }
+      const_iterator& operator++() { check(it != rows->end(), "cannot increment end iterator"); ++g_db.nexts; ++it; return *this; }
+      const_iterator operator++(int) { auto t = *this; ++(*this); return t; }
+      const_iterator& operator--() { check(it != rows->begin(), "cannot decrement iterator at beginning of table"); ++g_db.nexts; --it; return *this; }
+      const_iterator operator--(int) { auto t = *this; --(*this); return t; }
+      bool operator==(const const_iterator& o) const { return it == o.it; }
+      bool operator!=(const const_iterator& o) const { return it != o.it; }
+   };
+
+   const_iterator mk(typename rows_t::const_iterator i) const { const_iterator c; c.rows = rows; c.it = i; return c; }
+   const_iterator begin() const { return mk(rows->cbegin()); }
+   const_iterator end() const { return mk(rows->cend()); }
+   const_iterator find(uint64_t pk) const { ++g_db.finds; return mk(rows->find(pk)); }
+   const_iterator lower_bound(uint64_t pk) const { ++g_db.finds; return mk(rows->lower_bound(pk)); }
+   const_iterator upper_bound(uint64_t pk) const { ++g_db.finds; return mk(rows->upper_bound(pk)); }
+   const T& get(uint64_t pk, const char* msg = "unable to find key") const {
+      ++g_db.gets; auto i = rows->find(pk); check(i != rows->end(), msg); return i->second;
+   }
+   const_iterator iterator_to(const T& obj) const { return mk(rows->find(obj.primary_key())); }
+   uint64_t available_primary_key() const { return rows->empty() ? 0 : rows->rbegin()->first + 1; }
+
+   template <typename Lambda>
+   const_iterator emplace(name payer, Lambda&& constructor) {
+      check(payer.value != 0, "cannot pass empty payer when emplacing");
+      ++g_db.emplaces;
+      T obj{};
+      constructor(obj);
+      auto pk = obj.primary_key();
+      check(rows->find(pk) == rows->end(), "could not insert object, most likely a uniqueness constraint was violated");
+      auto r = rows->emplace(pk, obj);
+      return mk(r.first);
+   }
+   template <typename Lambda>
+   void modify(const const_iterator& itr, name payer, Lambda&& updater) {
+      check(itr.it != rows->end(), "cannot pass end iterator to modify");
+      modify(*itr, payer, std::forward<Lambda>(updater));
+   }
+   template <typename Lambda>
+   void modify(const T& obj, name payer, Lambda&& updater) {
+      ++g_db.modifies;
+      auto pk = obj.primary_key();
+      auto i = rows->find(pk);
+      check(i != rows->end(), "object passed to modify is not in multi_index");
+      T& m = i->second;
+      updater(m);
+      check(pk == m.primary_key(), "updater cannot change primary key when modifying an object");
+   }
+   const_iterator erase(const_iterator itr) {
+      check(itr.it != rows->end(), "cannot pass end iterator to erase");
+      ++g_db.erases;
+      auto n = rows->erase(itr.it);
+      return mk(n);
+   }
+   void erase(const T& obj) { ++g_db.erases; rows->erase(obj.primary_key()); }
+
+   template <typename Idx>
+   struct index {
+      using Extractor = typename Idx::secondary_extractor_type;
+      using key_t = typename Extractor::result_type;
+      multi_index* mi;
+      static key_t key(const T& r) { return Extractor()(r); }
+
+      struct const_iterator {
+         multi_index* mi = nullptr;
+         bool is_end = true;
+         uint64_t pk = 0;
+         const T& operator*() const { check(!is_end, "cannot dereference end iterator"); return mi->rows->at(pk); }
+         const T* operator->() const { return &**this; }
+         const_iterator& operator++() {
+            check(!is_end, "cannot increment end iterator");
+            ++g_db.nexts;
+            const T& cur = mi->rows->at(pk);
+            auto k = key(cur);
+            const T* best = nullptr;
+            for (auto& [p, r] : *mi->rows) {
+               auto rk = key(r);
+               if (rk > k || (rk == k && p > pk)) {
+                  if (!best || rk < key(*best) || (rk == key(*best) && p < best->primary_key())) best = &r;
+               }
+            }
+            if (best) pk = best->primary_key(); else is_end = true;
+            return *this;
+         }
+         const_iterator operator++(int) { auto t = *this; ++(*this); return t; }
+         const_iterator& operator--() {
+            ++g_db.nexts;
+            const T* best = nullptr;
+            if (is_end) {
+               for (auto& [p, r] : *mi->rows)
+                  if (!best || key(r) > key(*best) || (key(r) == key(*best) && p > best->primary_key())) best = &r;
+            } else {
+               const T& cur = mi->rows->at(pk);
+               auto k = key(cur);
+               for (auto& [p, r] : *mi->rows) {
+                  auto rk = key(r);
+                  if (rk < k || (rk == k && p < pk))
+                     if (!best || rk > key(*best) || (rk == key(*best) && p > best->primary_key())) best = &r;
+               }
+            }
+            check(best != nullptr, "cannot decrement iterator at beginning of index");
+            pk = best->primary_key(); is_end = false;
+            return *this;
+         }
+         const_iterator operator--(int) { auto t = *this; --(*this); return t; }
+         bool operator==(const const_iterator& o) const { return is_end == o.is_end && (is_end || pk == o.pk); }
+         bool operator!=(const const_iterator& o) const { return !(*this == o); }
+      };
+      const_iterator mkend() const { const_iterator c; c.mi = mi; return c; }
+      template <typename Pred>
+      const_iterator first_where(Pred p) const {
+         ++g_db.idxseeks;
+         const T* best = nullptr;
+         for (auto& [pk, r] : *mi->rows)
+            if (p(key(r)) && (!best || key(r) < key(*best) || (key(r) == key(*best) && pk < best->primary_key()))) best = &r;
+         auto c = mkend();
+         if (best) { c.is_end = false; c.pk = best->primary_key(); }
+         return c;
+      }
+      const_iterator begin() const { return first_where([](const key_t&) { return true; }); }
+      const_iterator end() const { return mkend(); }
+      const_iterator lower_bound(const key_t& k) const { return first_where([&](const key_t& x) { return !(x < k); }); }
+      const_iterator upper_bound(const key_t& k) const { return first_where([&](const key_t& x) { return k < x; }); }
+      const_iterator find(const key_t& k) const { auto c = lower_bound(k); if (c != end() && !(key(*c) == k)) return end(); return c; }
+      const T& get(const key_t& k, const char* msg = "unable to find secondary key") const { auto c = find(k); check(c != end(), msg); return *c; }
+      const_iterator iterator_to(const T& obj) const { auto c = mkend(); c.is_end = false; c.pk = obj.primary_key(); return c; }
+      template <typename Lambda>
+      void modify(const_iterator itr, name payer, Lambda&& updater) { mi->modify(*itr, payer, std::forward<Lambda>(updater)); }
+      const_iterator erase(const_iterator itr) {
+         check(!itr.is_end, "cannot pass end iterator to erase");
+         auto n = itr; ++n;
+         mi->erase(mi->rows->at(itr.pk));
+         return n;
+      }
+   };
+
+   template <name::raw IndexName>
+   auto get_index() {
+      return get_index_impl<IndexName, Indices...>();
+   }
+   template <name::raw IndexName>
+   auto get_index() const {
+      return const_cast<multi_index*>(this)->template get_index_impl<IndexName, Indices...>();
+   }
+ private:
+   template <name::raw IndexName, typename First, typename... Rest>
+   auto get_index_impl() {
+      if constexpr (First::index_name == IndexName) { index<First> i; i.mi = this; return i; }
+      else { static_assert(sizeof...(Rest) > 0, "unknown index"); return get_index_impl<IndexName, Rest...>(); }
+   }
+};
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+namespace eosio {
+struct name {
+   enum class raw : uint64_t {};
+   uint64_t value = 0;
+   constexpr name() = default;
+   constexpr explicit name(uint64_t v) : value(v) {}
+   constexpr explicit name(raw r) : value((uint64_t)r) {}
+   constexpr explicit name(std::string_view s) : value(0) {
+      if (s.size() > 13) throw "name too long";
+      uint64_t n = 0; int i = 0;
+      for (; i < (int)s.size() && i < 12; ++i) n |= (char_to_value(s[i]) & 0x1f) << (64 - 5 * (i + 1));
+      if (s.size() == 13) n |= char_to_value(s[12]) & 0x0F;
+      value = n;
+   }
+   static constexpr uint64_t char_to_value(char c) {
+      if (c == '.') return 0;
+      if (c >= '1' && c <= '5') return (c - '1') + 1;
+      if (c >= 'a' && c <= 'z') return (c - 'a') + 6;
+      throw "bad name char";
+   }
+   constexpr operator raw() const { return raw(value); }
+   constexpr explicit operator bool() const { return value != 0; }
+   std::string to_string() const {
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      std::string str(13, '.');
+      uint64_t tmp = value;
+      for (uint32_t i = 0; i <= 12; ++i) {
+         char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+         str[12 - i] = c;
+         tmp >>= (i == 0 ? 4 : 5);
+      }
+      while (!str.empty() && str.back() == '.') str.pop_back();
+      return str;
+   }
+   friend constexpr bool operator==(const name& a, const name& b) { return a.value == b.value; }
+   friend constexpr bool operator!=(const name& a, const name& b) { return a.value != b.value; }
+   friend constexpr bool operator<(const name& a, const name& b) { return a.value < b.value; }
+};
+namespace detail { template <char... Str> struct to_const_char_arr { static constexpr const char value[] = {Str...}; }; }
+}
+template <typename T, T... Str>
+inline constexpr eosio::name operator""_n() {
+   return eosio::name{std::string_view{eosio::detail::to_const_char_arr<Str...>::value, sizeof...(Str)}};
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+namespace eosio {
+extern uint32_t g_now;
+struct time_point_sec { uint32_t utc_seconds; uint32_t sec_since_epoch() const { return utc_seconds; } };
+struct time_point { uint32_t s; uint32_t sec_since_epoch() const { return s; } };
+inline time_point current_time_point() { return time_point{g_now}; }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "action.hpp"
+#include "system.hpp"
+#include <map>
+namespace eosio {
+struct transaction {
+   std::vector<action> actions;
+   uint32_t delay_sec = 0;
+   time_point_sec expiration{};
+   void send(const unsigned __int128& sender_id, name payer, bool replace_existing = false) const;
+};
+struct deferred_rec { uint32_t delay; std::vector<std::string> acts; };
+extern std::map<unsigned __int128, deferred_rec> g_deferred;
+inline void transaction::send(const unsigned __int128& sender_id, name, bool replace_existing) const {
+   check(replace_existing || g_deferred.count(sender_id) == 0, "deferred transaction with the same sender_id and payer already exists");
+   deferred_rec r{delay_sec, {}};
+   for (auto& a : actions) r.acts.push_back(a.act.to_string());
+   g_deferred[sender_id] = r;
+}
+inline int cancel_deferred(const unsigned __int128& sender_id) { return (int)g_deferred.erase(sender_id); }
+}
@@ -0,0 +1,16 @@
+#include <eosio/eosio.hpp>
+#include <eosio/transaction.hpp>
+
+namespace eosio {
+   bool g_print = false;
+   uint32_t g_now = 1700000000;
+   dbstats g_db;
+   mock_env g_env;
+   std::map<unsigned __int128, deferred_rec> g_deferred;
+
+   std::vector<std::function<void()>>& mock_resets()
+   {
+      static std::vector<std::function<void()>> resets;
+      return resets;
+   }
+}
@@ -0,0 +1,559 @@
+//-- scenario checks on the native harness, each test starts from an empty chain
+
+#include "harness.hpp"
+
+using namespace harness;
+
+namespace {
+
+   struct testcase {
+      const char* name;
+      void (*run)();
+   };
+
+   std::vector<testcase>& tests()
+   {
+      static std::vector<testcase> all;
+      return all;
+   }
+
+   struct registrar {
+      registrar(const char* name, void (*run)()) { tests().push_back({ name, run }); }
+   };
+
+   #define TEST(name) \
+      void name(); \
+      registrar name##_registrar(#name, &name); \
+      void name()
+
+   int g_failures = 0;
+
+   void expect(const bool pred, const char* what)
+   {
+      if (!pred) {
+         std::printf("    expected: %s\n", what);
+         g_failures++;
+      }
+   }
+
+   template<typename F>
+   void expectok(const char* what, F f)
+   {
+      auto work = measure(f);
+      if (work.failed) {
+         std::printf("    %s failed: %s\n", what, work.error.c_str());
+         g_failures++;
+      }
+   }
+
+   template<typename F>
+   void expectfail(const char* what, const std::string& error, F f)
+   {
+      auto work = measure(f);
+      if (!work.failed) {
+         std::printf("    %s did not fail\n", what);
+         g_failures++;
+      }
+      else if (work.error != error) {
+         std::printf("    %s failed with \"%s\", expected \"%s\"\n", what, work.error.c_str(), error.c_str());
+         g_failures++;
+      }
+   }
+
+   const token::pool& poolrow(const name poolName)
+   {
+      token::poolstable pools(N("aim"), N("aim").value);
+      return pools.get_index<"poolname"_n>().get(poolName.value);
+   }
+
+
+   TEST(booking_keeps_supply)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+      const auto total = totalbalances(spec);
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(3000)); });
+
+      expect(totalbalances(spec) == total, "balances sum to the supply after a booking");
+   }
+
+   TEST(booking_borrows_cheapest_pool_first)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(2500)); });
+
+      expect(poolrow(poolacnt(0)).avlblTokens.amount == 0, "cheapest pool lent all its tokens");
+      expect(poolrow(poolacnt(1)).avlblTokens.amount == tokens(1500).amount, "next pool lent the rest");
+      expect(poolrow(poolacnt(2)).avlblTokens.amount == tokens(2000).amount, "dearest pool untouched");
+   }
+
+   TEST(booking_spills_to_mainpool)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+      const auto mainBefore = balance(N("mainpool.aim"));
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(7000)); });
+
+      token::poolTokenReqs legs(N("aim"), N("aim").value);
+      int64_t fromMain = 0;
+      for (const auto& leg : legs) {
+         if (leg.poolID == 0) {
+            fromMain += leg.totalTokens.amount;
+         }
+      }
+
+      expect(fromMain == tokens(1000).amount, "main pool lent what the pools lacked");
+      expect(balance(N("mainpool.aim")) >= mainBefore, "main pool got its tokens and reward back");
+   }
+
+   TEST(booking_fails_on_empty_mainpool)
+   {
+      chainspec spec;
+      spec.mainpoolTokens = 0;
+      chain(spec);
+      auto c = modihost();
+
+      //-- the pools hold 6000 tokens, the rest would have to come from the empty main pool
+      auth({ hotelacnt(0) });
+      expectfail("reqservice", "Insufficient main pool token balance.", [&] { c.reqservice(1, hotelacnt(0), tokens(7000)); });
+      expect(balance(N("mainpool.aim")) == 0, "main pool balance untouched");
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice within the pools", [&] { c.reqservice(2, hotelacnt(0), tokens(6000)); });
+   }
+
+   //-- v1 pool rows as the contract before basis points wrote them
+   void v1pools()
+   {
+      token::poolstablev1 poolsv1(N("aim"), N("aim").value);
+
+      for (uint64_t id : { 0, 1 }) {
+         poolsv1.emplace(N("aim"), [&]( auto& row ) {
+            row.ID = id;
+            row.poolName = id == 0 ? N("mainpool.aim") : poolacnt(0);
+            row.ownerAcnt = id == 0 ? N("mainpool.aim") : collacnt(0);
+            row.colaterlAcnt = row.ownerAcnt;
+            row.rewardAcnt = id == 0 ? N("mainpool.aim") : rwdacnt(0);
+            row.reward = id == 0 ? 0.1 : 2.5;
+            row.isPrivate = false;
+            row.ownerShare = id == 0 ? 100 : 20;
+            row.holderShare = id == 0 ? 0 : 80;
+            row.totalTokens = tokens(1000);
+            row.avlblTokens = tokens(1000);
+            row.colaterlAmnt = tokens(150000);
+            row.ownerAvlblReward = tokens(0);
+            row.lockTime = g_now;
+            row.lockInSecs = id == 0 ? 0 : 1471;
+            row.createdDate = g_now;
+            row.isActive = true;
+         });
+      }
+
+      token::poolTokenReqsv1 reqsv1(N("aim"), N("aim").value);
+      reqsv1.emplace(N("aim"), [&]( auto& row ) {
+         row.ID = 0;
+         row.TID = 7;
+         row.hotel = hotelacnt(0);
+         row.poolID = 1;
+         row.pool = poolacnt(0);
+         row.totalTokens = tokens(100);
+         row.rewardPerc = 2.5;
+         row.rewardTokens = tokens(2);
+         row.createdDate = g_now;
+         row.ownerRewardTokens = tokens(0);
+      });
+   }
+
+   TEST(migratepools_converts_percentages)
+   {
+      reset();
+      v1pools();
+      auto c = modihost();
+
+      for (auto a : { "escrow1.aim", "escrow2.aim", "escrow3.aim", "escrow4.aim" }) {
+         newaccount(N(a));
+      }
+
+      auth({ N("aim") });
+      expectfail("initialize before the migration", "Run migratepools first.", [&] { c.initialize(); });
+      expectok("migratepools", [&] { c.migratepools(2); c.migratepools(10); });
+
+      token::poolstablev1 poolsv1(N("aim"), N("aim").value);
+      token::poolTokenReqsv1 reqsv1(N("aim"), N("aim").value);
+      expect(poolsv1.begin() == poolsv1.end() && reqsv1.begin() == reqsv1.end(), "v1 tables empty");
+
+      token::poolstable pools(N("aim"), N("aim").value);
+      const auto& mainPool = pools.get(0);
+      const auto& pool = pools.get(1);
+      expect(mainPool.reward == 10 && mainPool.ownerShare == 10000 && mainPool.holderShare == 0, "main pool percentages in bps");
+      expect(pool.reward == 250 && pool.ownerShare == 2000 && pool.holderShare == 8000, "pool percentages in bps");
+      expect(pool.avlblTokens == tokens(1000) && pool.lockInSecs == 1471, "pool tokens and lock time kept");
+      expect(pool.holderPolicy == c.m_plcyLru, "pool borrows from holders by last use");
+
+      token::poolTokenReqs reqs(N("aim"), N("aim").value);
+      expect(reqs.get(0).rewardPerc == 250 && reqs.get(0).TID == 7, "booking leg reward in bps");
+   }
+
+   TEST(migratev2_keeps_holder_rewards)
+   {
+      reset();
+      v1pools();
+      auto c = modihost();
+
+      token::poolholdersv1 holdersv1(N("aim"), N("aim").value);
+      holdersv1.emplace(N("aim"), [&]( auto& row ) {
+         row.ID = 0;
+         row.poolName = poolacnt(0);
+         row.holder = hldracnt(0, 0);
+         row.tokens = tokens(1000);
+         row.remainingTokens = tokens(1000);
+         row.availableReward = tokens(5);
+         row.lastUsedAt = g_now;
+         row.createdDate = g_now;
+         row.isActive = true;
+      });
+
+      auth({ N("aim") });
+      expectok("migratepools", [&] { c.migratepools(10); });
+
+      //-- reward credited while the holder is still a v1 row, the pool's tokens are all that holder's
+      token::poolstable pools(N("aim"), N("aim").value);
+      pools.modify(pools.find(1), N("aim"), [&]( auto& row ) { c.creditholders(row, tokens(10).amount); });
+
+      auth({ N("aim") });
+      expectok("migratev2", [&] { c.migratev2(10); });
+
+      token::poolholders holders(N("aim"), N("aim").value);
+      const auto& holder = holders.get(0);
+      expect(holder.tokens == tokens(1000).amount && holder.remainingTokens == tokens(1000).amount, "holder tokens kept");
+      expect(c.hldrreward(pools.get(1), holder) == tokens(15).amount, "holder keeps its reward and the one credited before it moved");
+      expect(pools.get(1).activeHolders == 1 && pools.get(1).hldrRewards == tokens(15).amount, "holder counted in its pool");
+   }
+
+   TEST(holder_actions_wait_for_migratev2)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      //-- a holder row not moved yet, with an ID the v2 table would hand out next
+      token::poolholders holders(N("aim"), N("aim").value);
+      const uint64_t nextID = holders.available_primary_key();
+      const name holder = N("late");
+      newaccount(holder);
+      auth({ N("aim") });
+      c.transfer(N("aim"), holder, tokens(500), "");
+
+      token::poolholdersv1 holdersv1(N("aim"), N("aim").value);
+      holdersv1.emplace(N("aim"), [&]( auto& row ) {
+         row.ID = nextID;
+         row.poolName = poolacnt(0);
+         row.holder = holder;
+         row.tokens = tokens(0);
+         row.remainingTokens = tokens(0);
+         row.availableReward = tokens(0);
+         row.lastUsedAt = g_now;
+         row.createdDate = g_now;
+         row.isActive = true;
+      });
+
+      auth({ hotelacnt(0) });
+      expectfail("reqservice", "Run migratev2 first.", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); });
+      auth({ holder });
+      expectfail("addpoolholdr", "Run migratev2 first.", [&] { c.addpoolholdr(poolacnt(0), holder, tokens(500)); });
+      auth({ hldracnt(0, 0) });
+      expectfail("leavepool", "Run migratev2 first.", [&] { c.leavepool(poolacnt(0), hldracnt(0, 0)); });
+
+      auth({ N("aim") });
+      expectok("migratev2", [&] { c.migratev2(10); });
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); });
+      auth({ holder });
+      expectok("lendmoretkns", [&] { c.lendmoretkns(poolacnt(0), holder, tokens(500)); });
+      expect(holders.get(nextID).holder == holder && holders.get(nextID).tokens == tokens(500).amount, "moved holder kept its ID and lent more");
+   }
+
+   TEST(trminatepool_pays_holders_with_stale_count)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      token::poolstable pools(N("aim"), N("aim").value);
+      pools.modify(pools.get(poolrow(poolacnt(0)).ID), N("aim"), [&]( auto& row ) { row.activeHolders = 0; });
+
+      auth({ collacnt(0) });
+      expectok("trminatepool", [&] { c.trminatepool(poolacnt(0), 1); c.trminatepool(poolacnt(0), 1); });
+
+      token::trmntstates states(N("aim"), N("aim").value);
+      expect(states.begin() == states.end(), "termination done");
+      expect(balance(hldracnt(0, 0)) == tokens(spec.deposit).amount && balance(hldracnt(0, 1)) == tokens(spec.deposit).amount, "every holder paid back");
+      expect(balance(poolacnt(0)) == 0, "pool emptied");
+   }
+
+   TEST(prunereqs_bounds_min_age)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auto params = c.cfg();
+      params.pruneMinAge = c.m_maxPruneAge + 1;
+      auth({ N("aim") });
+      expectfail("setconfig past the max prune age", "Invalid prune age.", [&] { c.setconfig(params); });
+
+      params.pruneMinAge = 3600;
+      auth({ N("aim") });
+      expectok("setconfig", [&] { c.setconfig(params); });
+
+      auth({ N("aim") });
+      expectfail("prunereqs under pruneMinAge", "Invalid minAge.", [&] { c.prunereqs(0, 60, 10); });
+      auth({ N("aim") });
+      expectfail("prunereqs past the max age", "Invalid minAge.", [&] { c.prunereqs(0, 0xffffffff, 10); });
+      auth({ N("aim") });
+      expectok("prunereqs", [&] { c.prunereqs(0, 3600, 10); });
+   }
+
+   TEST(booking_releases_expired_holder_locks)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(6000)); });
+      g_now += 100000;
+
+      //-- the global reclaim only gets to the first pool's lock, its holders are released when borrowed from
+      auto params = c.cfg();
+      params.lazyUnlockRows = 1;
+      auth({ N("aim") });
+      expectok("setconfig", [&] { c.setconfig(params); });
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(2, hotelacnt(0), tokens(2000)); });
+
+      token::poolholders holders(N("aim"), N("aim").value);
+      token::hldrtknlocks hldrLocks(N("aim"), N("aim").value);
+      uint32_t newLocks = 0;
+      for (const auto& lock : hldrLocks) {
+         const auto& holder = holders.get(lock.holderID);
+         newLocks += holder.poolName == poolacnt(0) && lock.lockedUntil > g_now ? 1 : 0;
+      }
+
+      expect(newLocks == 2, "both holders of the pool lent again");
+      expect(poolrow(poolacnt(0)).avlblTokens.amount == 0, "pool lent its released tokens");
+   }
+
+   TEST(trminatepool_releases_expired_holder_locks)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(2000)); });
+      g_now += 100000;
+      g_deferred.clear();
+
+      auth({ collacnt(0) });
+      expectok("trminatepool", [&] { c.trminatepool(poolacnt(0), 10); });
+      expect(balance(hldracnt(0, 0)) >= tokens(spec.deposit).amount && balance(hldracnt(0, 1)) >= tokens(spec.deposit).amount, "every holder paid back");
+   }
+
+   TEST(quote_counts_expired_locks)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(6000)); });
+      g_now += 100000;
+
+      //-- the global reclaim frees the first pool only, the others keep their expired locks
+      auto params = c.cfg();
+      params.lazyUnlockRows = 1;
+      auth({ N("aim") });
+      expectok("setconfig", [&] { c.setconfig(params); });
+
+      token::quote_result quoted;
+      auth({});
+      expectok("quote", [&] { quoted = c.quote(hotelacnt(0), tokens(3000)); });
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(2, hotelacnt(0), tokens(3000)); });
+
+      token::poolTokenReqs legs(N("aim"), N("aim").value);
+      std::vector<std::pair<name, int64_t>> booked;
+      for (const auto& leg : legs) {
+         if (leg.TID == 2) {
+            booked.push_back({ leg.pool, leg.totalTokens.amount });
+         }
+      }
+
+      expect(quoted.fills.size() == booked.size(), "quote has a fill per booking leg");
+      for (size_t i = 0; i < quoted.fills.size() && i < booked.size(); i++) {
+         expect(quoted.fills[i].pool == booked[i].first && quoted.fills[i].tokens.amount == booked[i].second, "fill matches the booking leg");
+      }
+      expect(!quoted.fills.empty() && quoted.fills[0].pool == poolacnt(0), "released pool quoted first");
+   }
+
+   TEST(setconfig_bounds_unlock_rows)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      for (uint32_t rows : { 0u, c.m_maxUnlockRows + 1 }) {
+         auto params = c.cfg();
+         params.unlockRows = rows;
+         auth({ N("aim") });
+         expectfail("setconfig unlockRows", "Invalid unlockRows.", [&] { c.setconfig(params); });
+
+         params = c.cfg();
+         params.lazyUnlockRows = rows;
+         auth({ N("aim") });
+         expectfail("setconfig lazyUnlockRows", "Invalid lazyUnlockRows.", [&] { c.setconfig(params); });
+      }
+
+      auto params = c.cfg();
+      params.unlockRows = c.m_maxUnlockRows;
+      params.lazyUnlockRows = 1;
+      auth({ N("aim") });
+      expectok("setconfig", [&] { c.setconfig(params); });
+   }
+
+   TEST(bookings_wait_for_migratepools)
+   {
+      chainspec spec;
+      chain(spec);
+      v1pools();
+      auto c = modihost();
+
+      //-- the v1 pools are moved, the v1 booking leg is not
+      auth({ N("aim") });
+      token::poolstable pools(N("aim"), N("aim").value);
+      for (auto id : { 0, 1 }) {
+         pools.erase(pools.get(id));
+      }
+      expectok("migratepools", [&] { c.migratepools(2); });
+
+      auth({ hotelacnt(0) });
+      expectfail("reqservice", "Run migratepools first.", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); });
+
+      auth({ N("aim") });
+      expectok("migratepools", [&] { c.migratepools(10); });
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); });
+
+      token::poolTokenReqs reqs(N("aim"), N("aim").value);
+      expect(reqs.get(0).TID == 7, "moved booking leg kept its ID");
+   }
+
+   TEST(initialize_needs_every_escrow_shard)
+   {
+      reset();
+      auto c = modihost();
+
+      for (auto a : { "aim", "escrow1.aim", "escrow2.aim", "escrow4.aim", "mainpool.aim" }) {
+         newaccount(N(a));
+      }
+
+      auth({ N("aim") });
+      expectfail("initialize without escrow3.aim", "escrow shard account does not exist", [&] { c.initialize(); });
+
+      auth({ N("aim") });
+      expectfail("setconfig without escrow3.aim", "escrow shard account does not exist", [&] { c.setconfig(c.cfg()); });
+   }
+
+   TEST(dltpool_needs_existing_pool)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ N("aim") });
+      expectfail("dltpool of a missing ID", "Pool does not exist.", [&] { c.dltpool(999); });
+   }
+
+   TEST(sethldrplcy_releases_leftover_holder_locks)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      //-- two locks on the first holder, the unlock gets to the pool's locks only
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); c.reqservice(2, hotelacnt(0), tokens(500)); });
+      g_now += 100000;
+      auth({ N("aim") });
+      expectok("unlkpooltkns", [&] { c.unlkpooltkns(2); });
+
+      auto params = c.cfg();
+      params.lazyUnlockRows = 1;
+      auth({ N("aim") });
+      expectok("setconfig", [&] { c.setconfig(params); });
+
+      auth({ collacnt(0) });
+      expectok("sethldrplcy", [&] { c.sethldrplcy(poolacnt(0), c.m_plcyProRata); });
+
+      token::poolholders holders(N("aim"), N("aim").value);
+      token::hldrtknlocks hldrLocks(N("aim"), N("aim").value);
+      bool released = hldrLocks.begin() == hldrLocks.end();
+      for (const auto& holder : holders) {
+         released = released && holder.remainingTokens == holder.tokens;
+      }
+      expect(released, "holder locks released before the policy switch");
+   }
+
+   TEST(unlock_needs_contract_auth)
+   {
+      chainspec spec;
+      chain(spec);
+      auto c = modihost();
+
+      auth({ hotelacnt(0) });
+      expectok("reqservice", [&] { c.reqservice(1, hotelacnt(0), tokens(500)); });
+      g_now += 100000;
+      g_deferred.clear();
+
+      auth({ hotelacnt(0) });
+      expectfail("unlkpooltkns by a hotel", "missing required authority aim", [&] { c.unlkpooltkns(100); });
+      expect(g_deferred.empty(), "no unlock scheduled by the failed call");
+
+      auth({ N("aim") });
+      expectok("unlkpooltkns", [&] { c.unlkpooltkns(100); });
+      expect(poolrow(poolacnt(0)).avlblTokens == poolrow(poolacnt(0)).totalTokens, "pool tokens released");
+   }
+
+} //-- end of namespace
+
+int main()
+{
+   int failedTests = 0;
+
+   for (const auto& t : tests()) {
+      int before = g_failures;
+      t.run();
+
+      bool ok = g_failures == before;
+      failedTests += ok ? 0 : 1;
+      std::printf("%s %s\n", ok ? "ok  " : "FAIL", t.name);
+   }
+
+   std::printf("%zu tests, %d failed\n", tests().size(), failedTests);
+   return failedTests == 0 ? 0 : 1;
+}
@@ -3,11 +3,33 @@
 #include <eosio/asset.hpp>
 #include <eosio/eosio.hpp>
 #include <eosio/system.hpp>
+#include <eosio/singleton.hpp>
+#include <eosio/binary_extension.hpp>
 #include <eosio/transaction.hpp> // include this for transactions
 
+#include <algorithm>
 #include <cmath>
+#include <map>
+#include <set>
 #include <string>
 #include <cstdlib>
+#include <limits>
+
+//-- build with -DMODIHOST_METRICS to count the work done per action and send it in a metrics inline action,
+//-- build with -DMODIHOST_DEBUG to keep the debug prints
+#ifdef MODIHOST_METRICS
+   #define MH_COUNT(field, n) (m_work.field += (n))
+   #define MH_EMIT(act) sendmetrics(act)
+#else
+   #define MH_COUNT(field, n) ((void)0)
+   #define MH_EMIT(act) ((void)0)
+#endif
+
+#ifdef MODIHOST_DEBUG
+   #define MH_PRINT(...) print(__VA_ARGS__)
+#else
+   #define MH_PRINT(...) ((void)0)
+#endif
 
 namespace eosiosystem {
    class system_contract;
@@ -31,6 +53,77 @@ namespace eosio {
       public:
          using contract::contract;
 
+         //-- one hotel booking for reqservicebt
+         struct service_req {
+            uint64_t TID;
+            name hotel;
+            asset tokens;
+         };
+
+         //-- one pool leg of a quote, in the order reqservice would borrow
+         struct quote_fill {
+            name pool;
+            uint64_t reward; // in basis points
+            asset tokens;
+            asset rewardTokens;
+         };
+
+         struct quote_result {
+            std::vector<quote_fill> fills;
+            asset totalTokens;
+            asset feesTokens;
+            asset rewardTokens;
+         };
+
+         //-- one holder of a poolhldrs page, reward includes what accrued since its last checkpoint
+         struct holder_row {
+            uint64_t ID;
+            name holder;
+            asset tokens;
+            asset remainingTokens;
+            asset reward;
+            bool isActive;
+         };
+
+         struct holder_page {
+            std::vector<holder_row> holders;
+            uint64_t next; // cursor for the next page
+            bool done; // last holder of the pool is in this page
+         };
+
+         //-- tunable parameters, the defaults below apply until setconfig writes the row
+         struct [[eosio::table]] config {
+            uint64_t modihostFees = 50; // in basis points
+            int64_t colateralAmount = 1000000000; // minimum pool collateral
+            uint64_t mainpoolReward = 10; // in basis points, used by initialize
+            uint64_t lockCoef = 5700000000; // lockinsecs numerator, 57000 * 100000
+            uint32_t unlockRows = 100; // lock rows released per scheduled unlkpooltkns call
+            uint32_t lazyUnlockRows = 10; // expired lock rows an action releases before it reads pools or holders
+            uint32_t pruneMinAge = 0; // seconds a settled booking is kept at least
+         };
+
+         //-- one record of a logevent, same layout for every kind
+         struct event_rec {
+            uint8_t kind;
+            uint64_t ref; // TID of a booking, lock ID of an unlock, holder ID or pool ID of a reward
+            name pool;
+            name account; // hotel, holder or owner
+            int64_t tokens;
+            int64_t reward;
+            int64_t fees;
+         };
+
+         //-- work done by one action, only counted in MODIHOST_METRICS builds
+         struct work_counters {
+            uint32_t poolsScanned = 0;
+            uint32_t holdersScanned = 0;
+            uint32_t rowsRead = 0; // db reads of pool, holder, lock and balance rows
+            uint32_t rowsModified = 0;
+            uint32_t rowsEmplaced = 0;
+            uint32_t rowsErased = 0;
+            uint32_t transfers = 0;
+         };
+
          /**
           * Create action.
           *
@@ -170,6 +263,30 @@ namespace eosio {
          [[eosio::action]]
          void dlttblhldrrq();
 
+         //-- erases settled bookings older than minAge seconds from fromTID on, at most maxRows rows per call,
+         //-- minAge is at least the config's pruneMinAge
+         [[eosio::action]]
+         void prunereqs(const uint64_t fromTID, const uint32_t minAge, const uint32_t maxRows);
+
+         //-- inline summary sent by prunereqs, does nothing
+         [[eosio::action]]
+         void prunelog(const uint64_t firstTID, const uint64_t lastTID, const uint32_t tids, const uint32_t poolRows,
+                        const uint32_t holderRows, const asset totalTokens, const asset feesTokens, const asset rewardTokens);
+
+         using prunelog_action = eosio::action_wrapper<"prunelog"_n, &token::prunelog>;
+
+         //-- inline work summary sent at the end of the booking and unlock actions in MODIHOST_METRICS builds, does nothing
+         [[eosio::action]]
+         void metrics(const name action, const work_counters counters);
+
+         using metrics_action = eosio::action_wrapper<"metrics"_n, &token::metrics>;
+
+         //-- inline booking, unlock and reward history for state-history consumers, one per action, does nothing
+         [[eosio::action]]
+         void logevent(const std::vector<event_rec> events);
+
+         using logevent_action = eosio::action_wrapper<"logevent"_n, &token::logevent>;
+
          [[eosio::action]]
          void dlttblstake();
 
@@ -186,9 +303,13 @@ namespace eosio {
          [[eosio::action]]
          void initialize();
 
+         //-- replaces the tunable parameters, aim only
+         [[eosio::action]]
+         void setconfig(const config params);
+
          [[eosio::action]]
-         void addpool(name poolName, name ownerAcnt, name colaterlAcnt, name rewardAcnt, double reward, 
-                        bool isPrivate, double ownerShare, double holderShare, const asset pCollateral, std::vector<name> arRestriction);
+         void addpool(name poolName, name ownerAcnt, name colaterlAcnt, name rewardAcnt, uint64_t reward, 
+                        bool isPrivate, uint64_t ownerShare, uint64_t holderShare, const asset pCollateral, std::vector<name> arRestriction);
          
          [[eosio::action]]
          void addpoolholdr(name poolName, name holder, asset tokens);
@@ -200,49 +321,118 @@ namespace eosio {
          void lendmoretkns(const name poolName, const name holder, const asset tokens);
          
          [[eosio::action]]
-         void chngepoolfee(const name poolName, const double reward);
+         void chngepoolfee(const name poolName, const uint64_t reward);
 
          [[eosio::action]]
-         void trminatepool(const name poolName);
+         void sethldrplcy(const name poolName, const uint8_t policy);
+
+         [[eosio::action]]
+         void setrestrict(const name poolName, const name hotel, const bool isRestricted);
+
+         //-- moves a pool's arRestriction list into the restriction table
+         [[eosio::action]]
+         void mvrestrict(const name poolName);
+
+         //-- pays out at most maxRows holders per call, call again until it prints "terminate done"
+         [[eosio::action]]
+         void trminatepool(const name poolName, const uint32_t maxRows);
 
          [[eosio::action]]
          void reqservice(const int p_TID, const name p_hotel, const asset p_tokens);
 
+         [[eosio::action]]
+         void reqservicebt(const std::vector<service_req> reqs);
+
+         //-- read only, returns the pools reqservice would borrow from right now, main pool last,
+         //-- counting the expired locks reqservice would release first
+         [[eosio::action, eosio::read_only]]
+         quote_result quote(const name p_hotel, const asset p_tokens);
+
+         //-- read only, returns at most `limit` holders of `pool` from holder ID `cursor`, walks only that pool's rows,
+         //-- stands in for scoping poolholders, hldrtknlock and holdertknreq per pool, the tables keep one scope
+         [[eosio::action, eosio::read_only]]
+         holder_page poolhldrs(const name pool, const uint64_t cursor, const uint32_t limit);
+
          [[eosio::action]]
          void sndfee2escrw(const int p_TID, const name from);
          
          [[eosio::action]]
          void servprvd2htl(const int p_TID);
 
+         //-- moves the booking fees kept on the escrow shards to modihost
+         [[eosio::action]]
+         void sweepescrow();
+
          [[eosio::action]]
          void wtdrwtknhldr(const name holder, const name pool);
          
          [[eosio::action]]
          void wtdrwtknownr(const name owner);
 
+         //-- pays at most `limit` holders from holder ID `cursor`, prints the next cursor
+         [[eosio::action]]
+         void payrewards(const name pool, const name owner, const uint64_t cursor, const uint32_t limit);
+
          [[eosio::action]]
-         void payrewards(const name pool, const name owner);
+         void unlkpooltkns(const uint32_t maxRows);
 
+         //-- moves at most maxRows pools and pooltokenreq rows to "pools2" and "pooltknreq2", percentages become basis points
          [[eosio::action]]
-         void unlkpooltkns();
+         void migratepools(const uint32_t maxRows);
+
+         //-- moves at most maxRows poolholders, pooltknlock and hldrtknlock rows to their compact v2 tables
+         [[eosio::action]]
+         void migratev2(const uint32_t maxRows);
+
+         //-- re-emplaces rows of `table` from primary key `fromID` so secondary indexes added later get populated
+         [[eosio::action]]
+         void rbldindex(const name table, const uint64_t fromID, const uint32_t maxRows);
 
       //-- END OF PUBLIC REGION
 
 
       private:
-         const double modihostFees = 0.5; // in %
-         const uint64_t colateralAmount = 1000000000;
+         const uint64_t m_bpsBase = 10000; // 100% in basis points
          const name m_modihost = name("aim");
-         const name m_escrow = name("escrow.aim");
+         //-- booking escrow legs go to one shard account per TID, so bookings on different shards write disjoint rows,
+         //-- initialize and setconfig check that every shard account exists
+         const name m_escrowShards[4] = { name("escrow1.aim"), name("escrow2.aim"), name("escrow3.aim"), name("escrow4.aim") };
+         const uint64_t m_escrowShardCount = sizeof(m_escrowShards) / sizeof(m_escrowShards[0]);
          const symbol_code m_symbol = symbol_code("AIM");
+         const symbol m_tknSymbol = symbol(m_symbol,4);
          const name m_mainpool = name("mainpool.aim");
          const name m_mainpoolrwd = name("mainpool.aim");
-         const double m_mainpoolrew = 0.1;
-         const asset m_zeroTokens = asset(0, symbol(m_symbol,4));
+         const uint128_t m_rewardScale = 1000000000000; // rewardPerToken precision
+         const uint8_t m_plcyLru = 0; // borrow locks holders one by one, least recently used first
+         const uint8_t m_plcyProRata = 1; // borrow locks only the pool, holders share the lock by their tokens
+         const uint8_t m_plcyLargest = 2; // borrow locks holders one by one, most remaining tokens first
+         const asset m_zeroTokens = asset(0, m_tknSymbol);
+         const uint8_t m_evBooking = 1; // pool leg of a booking
+         const uint8_t m_evSettled = 2; // booking settled with the hotel
+         const uint8_t m_evUnlock = 3; // pool or holder lock released
+         const uint8_t m_evHldrReward = 4; // reward paid to a holder, tokens are the principal returned with it
+         const uint8_t m_evOwnrReward = 5; // reward paid to a pool owner
+         const uint32_t m_maxUnlockRows = 1000; // upper bound of unlockRows and lazyUnlockRows, keeps an unlock within one action's CPU
+         const uint32_t m_maxPruneAge = 315360000; // 10 years, upper bound of pruneMinAge and prunereqs minAge
+         config m_cfg{};
+         bool m_cfgLoaded = false;
          
+         //-- poolholders "holderpool" index key, one row per holder and pool
+         static uint128_t hldrpoolkey( const name holder, const name pool ) { return (uint128_t{holder.value} << 64) | pool.value; }
+
+         //-- poolholders "poolid" index key, holders of one pool in ID order
+         static uint128_t hldrpoolidkey( const name pool, const uint64_t ID ) { return (uint128_t{pool.value} << 64) | ID; }
+
+         //-- poolholders "poolremain" index key, holders of one pool by remaining tokens
+         static uint128_t hldrpoolremkey( const name pool, const int64_t tokens ) { return (uint128_t{pool.value} << 64) | static_cast<uint64_t>(tokens > 0 ? tokens : 0); }
+
+         //-- pooltknlock "poolexpiry" and hldrtknlock "hldrexpiry" index key, locks of one pool or holder by expiry
+         static uint128_t lockexpirykey( const uint64_t ownerID, const uint32_t lockedUntil ) { return (uint128_t{ownerID} << 64) | lockedUntil; }
+
 
          struct [[eosio::table]] account {
             asset    balance;
+            eosio::binary_extension<int64_t> stakeTokens; // collateral locked in a pool, absent on rows written before it was kept here
 
             uint64_t primary_key()const { return balance.symbol.code().raw(); }
          };
@@ -255,7 +445,43 @@ namespace eosio {
             uint64_t primary_key()const { return supply.symbol.code().raw(); }
          };
 
+         //-- "pools2" layout, pools added before it are poolv1 rows until migratepools moves them
          struct [[eosio::table]] pool {
+            uint64_t ID;
+            name poolName;
+            name ownerAcnt;
+            name colaterlAcnt;
+            name rewardAcnt;
+            uint64_t reward; // in basis points
+            bool isPrivate;
+            uint64_t ownerShare; // in basis points of reward
+            uint64_t holderShare; // in basis points of reward
+            asset totalTokens;
+            asset avlblTokens;
+            asset colaterlAmnt;
+            asset ownerAvlblReward;
+            uint32_t lockTime;
+            uint32_t lockInSecs;
+            uint32_t createdDate;
+            bool isActive;
+            std::vector<name> arRestriction; // only on pools added before the restriction table, moved by mvrestrict
+            uint128_t rewardPerToken; // holders' reward per lent token, scaled by m_rewardScale
+            uint8_t holderPolicy; // m_plcyLru, m_plcyProRata or m_plcyLargest
+            uint32_t activeHolders;
+            int64_t hldrRewards; // reward account tokens owed to holders, credited minus paid out
+            
+            uint64_t primary_key() const { return ID; }
+            uint64_t pkpool() const { return poolName.value; }
+            uint64_t pkownr() const { return ownerAcnt.value; }
+            uint64_t pkfee() const { return reward; }
+
+            //-- pools reqservice can borrow from sort first, cheapest reward first
+            bool isborrowable() const { return ID != 0 && isActive && avlblTokens.amount > 0; }
+            uint128_t pkeligible() const { return (uint128_t{isborrowable() ? 0u : 1u} << 64) | reward; }
+         };
+
+         //-- pool layout before "pools2", percentages are doubles in %, read by migratepools only
+         struct [[eosio::table]] poolv1 {
             uint64_t ID;
             name poolName;
             name ownerAcnt;
@@ -281,7 +507,31 @@ namespace eosio {
             double pkfee() const { return reward; }
          };
 
+         //-- token amounts are raw amounts of m_symbol
          struct [[eosio::table]] poolholder {
+            uint64_t ID;
+            name poolName;
+            name holder;
+            int64_t tokens;
+            int64_t remainingTokens;
+            int64_t availableReward;
+            uint32_t lastUsedAt;
+            uint32_t createdDate;
+            bool isActive;
+            uint128_t rewardCheckpoint; // pool rewardPerToken when availableReward was last credited
+
+            uint64_t primary_key() const { return ID; }
+            uint64_t pkholder() const { return holder.value; }
+            uint64_t pkhldrpool() const { return poolName.value; }
+            uint64_t pklastused() const { return lastUsedAt; }
+            uint128_t pkpoollast() const { return (uint128_t{poolName.value} << 64) | lastUsedAt; }
+            uint128_t pkholderpool() const { return hldrpoolkey(holder, poolName); }
+            uint128_t pkpoolid() const { return hldrpoolidkey(poolName, ID); }
+            uint128_t pkpoolremain() const { return hldrpoolremkey(poolName, remainingTokens); }
+         };
+
+         //-- poolholder layout and indexes before "poolholder2", read by migratev2 only
+         struct [[eosio::table]] poolholderv1 {
             uint64_t ID;
             name poolName;
             name holder;
@@ -318,7 +568,25 @@ namespace eosio {
             uint64_t poolID;
             name pool;
             asset totalTokens;
-            double rewardPerc;
+            uint64_t rewardPerc; // in basis points
+            asset rewardTokens;
+            uint32_t createdDate;
+            asset ownerRewardTokens;
+
+            uint64_t primary_key() const { return ID; }
+            uint64_t pktid() const { return TID; }
+            uint64_t pkpool() const { return pool.value; }
+         };
+
+         //-- poolTokenReq layout before "pooltknreq2", read by migratepools only
+         struct [[eosio::table]] poolTokenReqv1 {
+            uint64_t ID;
+            uint64_t TID;
+            name hotel;
+            uint64_t poolID;
+            name pool;
+            asset totalTokens;
+            double rewardPerc; // in %
             asset rewardTokens;
             uint32_t createdDate;
             asset ownerRewardTokens;
@@ -344,6 +612,32 @@ namespace eosio {
          };
 
          struct [[eosio::table]] pooltknlock {
+            uint64_t ID;
+            uint64_t poolID;
+            int64_t tokens;
+            uint32_t lockedUntil;
+            uint32_t createdDate;
+            
+            uint64_t primary_key() const { return ID; }
+            uint64_t pklockeduntil() const { return lockedUntil; }
+            uint128_t pkpoolexpiry() const { return lockexpirykey(poolID, lockedUntil); }
+         };
+
+         //-- pool, holder and pool name come from the poolholder row
+         struct [[eosio::table]] hldrtknlock {
+            uint64_t ID;
+            uint64_t holderID;
+            int64_t tokens;
+            uint32_t lockedUntil;
+            uint32_t createdDate;
+            
+            uint64_t primary_key() const { return ID; }
+            uint64_t pklockeduntil() const { return lockedUntil; }
+            uint128_t pkhldrexpiry() const { return lockexpirykey(holderID, lockedUntil); }
+         };
+
+         //-- lock layouts before "pooltknlck2" and "hldrtknlck2", read by migratev2 only
+         struct [[eosio::table]] pooltknlockv1 {
             uint64_t ID;
             uint64_t poolID;
             name poolName;
@@ -352,9 +646,10 @@ namespace eosio {
             uint32_t createdDate;
             
             uint64_t primary_key() const { return ID; }
+            uint64_t pklockeduntil() const { return lockedUntil; }
          };
 
-         struct [[eosio::table]] hldrtknlock {
+         struct [[eosio::table]] hldrtknlockv1 {
             uint64_t ID;
             uint64_t poolID;
             name poolName;
@@ -365,6 +660,12 @@ namespace eosio {
             uint32_t createdDate;
             
             uint64_t primary_key() const { return ID; }
+            uint64_t pklockeduntil() const { return lockedUntil; }
+         };
+
+         struct [[eosio::table]] unlocktimer {
+            uint32_t nextUnlockAt; // 0 when no unlock is scheduled
+            uint32_t scheduledAt;
          };
 
          struct [[eosio::table]] stake {
@@ -375,47 +676,259 @@ namespace eosio {
             uint64_t primary_key() const { return colateral.value; }
          };
 
+         //-- hotels a pool does not lend to, scoped by pool name
+         struct [[eosio::table]] restriction {
+            name hotel;
+
+            uint64_t primary_key() const { return hotel.value; }
+         };
+
+         //-- booking fees held on an escrow shard account until sweepescrow
+         struct [[eosio::table]] escrowfee {
+            name shard;
+            int64_t fees;
+
+            uint64_t primary_key() const { return shard.value; }
+         };
+
+         //-- progress of a multi-step trminatepool, erased when the pool is closed
+         struct [[eosio::table]] trmntstate {
+            name poolName;
+            uint64_t cursor; // next holder ID to pay out
+            uint32_t startedAt;
+
+            uint64_t primary_key() const { return poolName.value; }
+         };
+
 
          typedef eosio::multi_index< "accounts"_n, account > accounts;
          typedef eosio::multi_index< "stat"_n, currency_stats > stats;
          typedef eosio::multi_index< "hotelfeereq"_n, hotelFeeReq > hotelFeeReqs;
-         typedef eosio::multi_index< "pooltknlock"_n, pooltknlock > pooltknlocks;
-         typedef eosio::multi_index< "hldrtknlock"_n, hldrtknlock > hldrtknlocks;
          typedef eosio::multi_index< "stakes"_n, stake > stakes;
+         typedef eosio::singleton< "unlocktimer"_n, unlocktimer > unlocktimers;
+         typedef eosio::singleton< "config"_n, config > configs;
+         typedef eosio::multi_index< "trmntstate"_n, trmntstate > trmntstates;
+         typedef eosio::multi_index< "restriction"_n, restriction > restrictions;
+         typedef eosio::multi_index< "escrowfee"_n, escrowfee > escrowfees;
 
          
-         typedef eosio::multi_index< "poolholders"_n, poolholder, 
+         typedef eosio::multi_index< "poolholder2"_n, poolholder, 
             eosio::indexed_by< "holder"_n, eosio::const_mem_fun<poolholder, uint64_t, &poolholder::pkholder>>,
             eosio::indexed_by< "poolname"_n, eosio::const_mem_fun<poolholder, uint64_t, &poolholder::pkhldrpool>>,
-            eosio::indexed_by< "lastusedat"_n, eosio::const_mem_fun<poolholder, uint64_t, &poolholder::pklastused>>
+            eosio::indexed_by< "lastusedat"_n, eosio::const_mem_fun<poolholder, uint64_t, &poolholder::pklastused>>,
+            eosio::indexed_by< "poollastused"_n, eosio::const_mem_fun<poolholder, uint128_t, &poolholder::pkpoollast>>,
+            eosio::indexed_by< "holderpool"_n, eosio::const_mem_fun<poolholder, uint128_t, &poolholder::pkholderpool>>,
+            eosio::indexed_by< "poolid"_n, eosio::const_mem_fun<poolholder, uint128_t, &poolholder::pkpoolid>>,
+            eosio::indexed_by< "poolremain"_n, eosio::const_mem_fun<poolholder, uint128_t, &poolholder::pkpoolremain>>
          > poolholders;
 
-         typedef eosio::multi_index< "pools"_n, pool,
+         typedef eosio::multi_index< "poolholders"_n, poolholderv1, 
+            eosio::indexed_by< "holder"_n, eosio::const_mem_fun<poolholderv1, uint64_t, &poolholderv1::pkholder>>,
+            eosio::indexed_by< "poolname"_n, eosio::const_mem_fun<poolholderv1, uint64_t, &poolholderv1::pkhldrpool>>,
+            eosio::indexed_by< "lastusedat"_n, eosio::const_mem_fun<poolholderv1, uint64_t, &poolholderv1::pklastused>>
+         > poolholdersv1;
+
+         typedef eosio::multi_index< "pools2"_n, pool,
             eosio::indexed_by< "poolname"_n, eosio::const_mem_fun<pool, uint64_t, &pool::pkpool>>,
             eosio::indexed_by< "owner"_n, eosio::const_mem_fun<pool, uint64_t, &pool::pkownr>>,
-            eosio::indexed_by< "reward"_n, eosio::const_mem_fun<pool, double, &pool::pkfee>>
+            eosio::indexed_by< "reward"_n, eosio::const_mem_fun<pool, uint64_t, &pool::pkfee>>,
+            eosio::indexed_by< "eligible"_n, eosio::const_mem_fun<pool, uint128_t, &pool::pkeligible>>
          > poolstable;
 
+         typedef eosio::multi_index< "pools"_n, poolv1,
+            eosio::indexed_by< "poolname"_n, eosio::const_mem_fun<poolv1, uint64_t, &poolv1::pkpool>>,
+            eosio::indexed_by< "owner"_n, eosio::const_mem_fun<poolv1, uint64_t, &poolv1::pkownr>>,
+            eosio::indexed_by< "reward"_n, eosio::const_mem_fun<poolv1, double, &poolv1::pkfee>>
+         > poolstablev1;
+
+         typedef eosio::multi_index< "pooltknlck2"_n, pooltknlock,
+            eosio::indexed_by< "lockeduntil"_n, eosio::const_mem_fun<pooltknlock, uint64_t, &pooltknlock::pklockeduntil>>,
+            eosio::indexed_by< "poolexpiry"_n, eosio::const_mem_fun<pooltknlock, uint128_t, &pooltknlock::pkpoolexpiry>>
+         > pooltknlocks;
+
+         typedef eosio::multi_index< "hldrtknlck2"_n, hldrtknlock,
+            eosio::indexed_by< "lockeduntil"_n, eosio::const_mem_fun<hldrtknlock, uint64_t, &hldrtknlock::pklockeduntil>>,
+            eosio::indexed_by< "hldrexpiry"_n, eosio::const_mem_fun<hldrtknlock, uint128_t, &hldrtknlock::pkhldrexpiry>>
+         > hldrtknlocks;
+
+         typedef eosio::multi_index< "pooltknlock"_n, pooltknlockv1,
+            eosio::indexed_by< "lockeduntil"_n, eosio::const_mem_fun<pooltknlockv1, uint64_t, &pooltknlockv1::pklockeduntil>>
+         > pooltknlocksv1;
+
+         typedef eosio::multi_index< "hldrtknlock"_n, hldrtknlockv1,
+            eosio::indexed_by< "lockeduntil"_n, eosio::const_mem_fun<hldrtknlockv1, uint64_t, &hldrtknlockv1::pklockeduntil>>
+         > hldrtknlocksv1;
+
          typedef eosio::multi_index< "holdertknreq"_n, holderTknReq, 
             eosio::indexed_by< "tid"_n, eosio::const_mem_fun<holderTknReq, uint64_t, &holderTknReq::pktid>>
          > holderTknReqs;
          
-         typedef eosio::multi_index< "pooltokenreq"_n, poolTokenReq, 
+         typedef eosio::multi_index< "pooltknreq2"_n, poolTokenReq, 
             eosio::indexed_by< "tid"_n, eosio::const_mem_fun<poolTokenReq, uint64_t, &poolTokenReq::pktid>>,
             eosio::indexed_by< "pool"_n, eosio::const_mem_fun<poolTokenReq, uint64_t, &poolTokenReq::pkpool>>
          > poolTokenReqs;
 
+         typedef eosio::multi_index< "pooltokenreq"_n, poolTokenReqv1, 
+            eosio::indexed_by< "tid"_n, eosio::const_mem_fun<poolTokenReqv1, uint64_t, &poolTokenReqv1::pktid>>,
+            eosio::indexed_by< "pool"_n, eosio::const_mem_fun<poolTokenReqv1, uint64_t, &poolTokenReqv1::pkpool>>
+         > poolTokenReqsv1;
+
+
+         //-- action scoped table handles for the booking path, balance, pool and holder rows
+         //-- are modified in memory and written back once by flush()
+         struct tblcache {
+            struct balancerow {
+               asset balance;
+               int64_t stakeTokens;
+               bool exists; // row found in accounts
+            };
+
+            name self;
+            uint64_t scope;
+            symbol_code sym;
+            symbol tknSymbol; // sym with the token's precision, built once per cache
+            stats statstable;
+            hotelFeeReqs hotelFeeReq;
+            poolstable pools;
+            poolTokenReqs poolTokenReq;
+            pooltknlocks poolTknLock;
+            poolholders holders;
+            hldrtknlocks hldrTknLock;
+            escrowfees escrowFee;
+
+            std::map<uint64_t, pool> poolRows;
+            std::map<uint64_t, poolholder> holderRows;
+            std::set<uint64_t> dirtyPools;
+            std::set<uint64_t> dirtyHolders;
+            std::map<uint64_t, balancerow> balances;
+            std::set<uint64_t> dirtyBalances;
+            std::map<uint64_t, int64_t> legs; // net amount per account of transfers not settled yet
+            std::set<uint64_t> trusted; // escrow shards checked by initialize and setconfig, settle skips is_account
+            std::map<uint64_t, int64_t> shardFees; // fees kept on each escrow shard by this action
+            uint32_t rowsRead = 0; // rows loaded from the db, cache hits not counted
+
+            tblcache(const name& self, const uint64_t scope, const symbol_code& sym);
+
+            const balancerow& getbalance(const name& owner);
+            void subbalance(const name& owner, const asset& value);
+            void addbalance(const name& owner, const asset& value);
+            asset projected(const name& owner);
+            void addleg(const name& from, const name& to, const asset& quantity);
+            void settle();
+            void addshardfee(const name& shard, const int64_t fees);
+
+            const pool& getpool(const uint64_t id);
+            pool& modpool(const uint64_t id);
+            const poolholder& getholder(const uint64_t id);
+            poolholder& modholder(const uint64_t id);
+            void flush(const name& payer);
+            uint32_t dirtyrows() const;
+         };
+
+
+         //-- amount * bps / 10000 rounded down, integer only
+         int64_t bpsamount( const int64_t amount, const uint64_t bps ) const
+         {
+            return static_cast<int64_t>( (int128_t{amount} * bps) / m_bpsBase );
+         }
+
+         //-- percentage of a v1 row in basis points, rounded to the nearest
+         static uint64_t pcttobps( const double pct )
+         {
+            check( pct >= 0 && pct <= 100, "Invalid percentage in v1 row." );
+
+            return static_cast<uint64_t>( pct * 100 + 0.5 );
+         }
+
+         //-- escrow shard account of a booking
+         name escrowshard( const uint64_t TID ) const
+         {
+            return m_escrowShards[TID % m_escrowShardCount];
+         }
+
+         //-- floor(sqrt(n)), one pass per pair of bits, at most 32 passes
+         static constexpr uint64_t isqrt( uint64_t n )
+         {
+            uint64_t root = 0;
+            uint64_t bit = uint64_t{1} << 62;
+
+            while (bit > n) {
+               bit >>= 2;
+            }
+            while (bit != 0) {
+               if (n >= root + bit) {
+                  n -= root + bit;
+                  root = (root >> 1) + bit;
+               }
+               else {
+                  root >>= 1;
+               }
+               bit >>= 2;
+            }
+            return root;
+         }
+
+         //-- pool lock time for a collateral amount, falls with the square root of the collateral
+         uint32_t lockinsecs( const int64_t collateral )
+         {
+            check( collateral > 0, "Invalid collateral amount." );
+
+            return static_cast<uint32_t>( cfg().lockCoef / (isqrt(collateral) * 100) );
+         }
+
+         //-- raw table amount as m_symbol asset
+         asset tknasset( const int64_t amount ) const
+         {
+            return asset( amount, m_tknSymbol );
+         }
 
-         asset sqroot(asset number);
+         bool canlend( tblcache& cache, const pool& curPool, const name& hotel );
+         bool isrestricted( const pool& curPool, const name& hotel );
+         static int64_t stakedtokens( const name& self, const uint64_t scope, const name& owner, const account& row );
+         void setstaked( const name& owner, const int64_t tokens );
          void sub_balance( const name& owner, const asset& value );
          void add_balance( const name& owner, const asset& value, const name& ram_payer );
          void sub_balance2( const name& owner, const asset& value, const name& ram_payer );
          void add_balance2( const name& owner, const asset& value, const name& ram_payer );
          void transfer2Esc( const name& from, const name& to, const asset& quantity, const string& memo );
-         void updhldrtkns( const int p_TID, const asset p_tokensRemaining, const name p_hotel, const name p_pool, const double p_reward, const double p_holderPerc, const uint32_t lockedUntil );
-         void updpoltottkn( const name& poolName, const uint64_t& poolID, const asset& tokens, const bool& increment );
+         void transfer2Esc( tblcache& cache, const name& from, const name& to, const asset& quantity, const string& memo );
+         void internalleg( tblcache& cache, const name& from, const name& to, const int64_t amount );
+         uint32_t bookservice( tblcache& cache, const service_req& req );
+         void payhotelfee( tblcache& cache, const hotelFeeReq& req, const name from );
+         void settleservice( tblcache& cache, const hotelFeeReq& req );
+         void updhldrtkns( tblcache& cache, const asset p_tokensRemaining, const name p_pool, const uint8_t policy, const uint32_t lockedUntil );
+         void creditholders( pool& pool, const int64_t rewardAmount ) const;
+         int64_t hldrreward( const pool& pool, const poolholder& holder ) const;
+         int64_t hldrlocked( const pool& pool, const poolholder& holder ) const;
+         void accruereward( const pool& pool, poolholder& holder ) const;
+         void updpoltottkn( const uint64_t& poolID, const asset& tokens, const bool& increment, const int32_t holders, const int64_t rewardsPaid );
+         void paidhldrrwd( const uint64_t poolID, const int64_t rewardsPaid );
+
+         work_counters m_work{};
+         void sendmetrics( const name& action );
+
+         std::vector<event_rec> m_events;
+         void logev( const uint8_t kind, const uint64_t ref, const name pool, const name account,
+                     const int64_t tokens, const int64_t reward, const int64_t fees );
+         void sendevents();
+
+         const config& cfg();
+         void chkshards();
+         void chkmigratepools();
+         void chkmigratev2();
 
          void calldeferred( uint32_t delay, uint128_t sender_id );
+         void schdlunlock( const uint32_t unlockAt );
+         uint32_t reclaimexpired( const uint32_t maxRows );
+         int64_t rlspoollocks( pooltknlocks& locks, const pool& pool, const uint32_t maxRows );
+         int64_t rlshldrlocks( hldrtknlocks& locks, const poolholder& holder, const uint32_t maxRows );
+         void reclaimpool( poolstable& pools, const uint64_t poolID, const uint32_t maxRows );
+         void reclaimholder( poolholders& holders, const uint64_t holderID, const uint32_t maxRows );
+         void reclaimpool( tblcache& cache, const uint64_t poolID, const uint32_t maxRows );
+         void reclaimholder( tblcache& cache, const uint64_t holderID, const uint32_t maxRows );
+
+         template<typename T>
+         uint64_t rebuildrows( T& table, const uint64_t fromID, const uint32_t maxRows );
 
       //-- END OF PRIVATE REGION
 
@@ -122,6 +122,36 @@ namespace eosio {
 
       sub_balance2( from, quantity, name(m_modihost) );
       add_balance2( to, quantity, name(m_modihost) );
+      MH_COUNT(transfers, 1);
+   }
+
+   //-- (private) transfer2Esc as a leg of the cached settlement, applied by tblcache::settle
+   void token::transfer2Esc( tblcache& cache,
+                        const name&    from,
+                        const name&    to,
+                        const asset&   quantity,
+                        const string&  memo )
+   {
+      check( from != to, "cannot transfer to self" );
+      const auto& st = cache.statstable.get( quantity.symbol.code().raw() );
+
+      check( quantity.is_valid(), "invalid quantity" );
+      check( quantity.amount > 0, "must transfer positive quantity" );
+      check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+      check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+      cache.addleg( from, to, quantity );
+      MH_COUNT(transfers, 1);
+   }
+
+   //-- (private) leg between accounts checked at addpool or owned by the contract, always m_symbol,
+   //-- skips the stats and asset checks of transfer2Esc, settle still checks `to` unless it is trusted
+   void token::internalleg( tblcache& cache, const name& from, const name& to, const int64_t amount )
+   {
+      check( amount > 0, "must transfer positive quantity" );
+
+      cache.addleg( from, to, tknasset(amount) );
+      MH_COUNT(transfers, 1);
    }
 
    void token::sub_balance( const name& owner, const asset& value )
@@ -132,18 +162,48 @@ namespace eosio {
       check( from.balance.amount >= value.amount, "overdrawn balance" );
 
       //-- check locked tokens in pool
-      stakes tblstakes(get_self(), get_first_receiver().value);
-      auto itrStake = tblstakes.find(owner.value);
-      if (itrStake != tblstakes.end())
+      auto stakeTokens = stakedtokens(get_self(), get_first_receiver().value, owner, from);
+      if (stakeTokens > 0)
       {
-         check(from.balance.amount >= (itrStake->tokens.amount + value.amount), "overdrawn balance, locked in pool collateral");
+         check(from.balance.amount >= (stakeTokens + value.amount), "overdrawn balance, locked in pool collateral");
       }
 
       from_acnts.modify( from, owner, [&]( auto& a ) {
          a.balance -= value;
+         a.stakeTokens = stakeTokens;
       });
    }
 
+   //-- (private) collateral locked for owner, the stakes table is only read for rows without stakeTokens
+   int64_t token::stakedtokens( const name& self, const uint64_t scope, const name& owner, const account& row )
+   {
+      if (row.stakeTokens.has_value()) {
+         return row.stakeTokens.value();
+      }
+
+      stakes tblstakes(self, scope);
+      auto itrStake = tblstakes.find(owner.value);
+      return itrStake != tblstakes.end() ? itrStake->tokens.amount : 0;
+   }
+
+   //-- (private) keeps the account row's stakeTokens in step with the stakes table
+   void token::setstaked( const name& owner, const int64_t tokens )
+   {
+      accounts acnts( get_self(), owner.value );
+      auto itr = acnts.find( m_symbol.raw() );
+
+      if( itr == acnts.end() ) {
+         acnts.emplace( get_self(), [&]( auto& a ){
+            a.balance = m_zeroTokens;
+            a.stakeTokens = tokens;
+         });
+      } else {
+         acnts.modify( itr, same_payer, [&]( auto& a ) {
+            a.stakeTokens = tokens;
+         });
+      }
+   }
+
    void token::add_balance( const name& owner, const asset& value, const name& ram_payer )
    {
       accounts to_acnts( get_self(), owner.value );
@@ -151,6 +211,7 @@ namespace eosio {
       if( to == to_acnts.end() ) {
          to_acnts.emplace( ram_payer, [&]( auto& a ){
          a.balance = value;
+         a.stakeTokens = 0;
          });
       } else {
          to_acnts.modify( to, same_payer, [&]( auto& a ) {
@@ -178,6 +239,7 @@ namespace eosio {
       if( to == to_acnts.end() ) {
          to_acnts.emplace( ram_payer, [&]( auto& a ){
          a.balance = value;
+         a.stakeTokens = 0;
          });
       } else {
          to_acnts.modify( to, ram_payer, [&]( auto& a ) {
@@ -202,6 +264,7 @@ namespace eosio {
       if( it == acnts.end() ) {
          acnts.emplace( ram_payer, [&]( auto& a ){
          a.balance = asset{0, symbol};
+         a.stakeTokens = 0;
          });
       }
    }
@@ -226,6 +289,8 @@ namespace eosio {
       
       poolstable pools(get_self(), get_first_receiver().value);
       auto itr = pools.find(id);
+      check( itr != pools.end(), "Pool does not exist." );
+
       pools.erase(itr);
    }
 
@@ -262,7 +327,6 @@ namespace eosio {
 
       poolTokenReqs tblpoolTokenReqs(get_self(), get_first_receiver().value);
       poolstable pools(get_self(), get_first_receiver().value);
-      asset zeroTokens (0, symbol(m_symbol,4));
 
       auto itr = tblpoolTokenReqs.begin();
       
@@ -270,7 +334,7 @@ namespace eosio {
       {
          auto hldrItr = pools.find(itr->poolID);
          pools.modify(hldrItr, get_self(), [&]( auto& row ) {
-            row.ownerAvlblReward = zeroTokens;
+            row.ownerAvlblReward = m_zeroTokens;
          });
 
          itr = tblpoolTokenReqs.erase(itr);
@@ -282,20 +346,161 @@ namespace eosio {
 
       holderTknReqs tblholderTknReqs(get_self(), get_first_receiver().value);
       poolholders holders (get_self(), get_first_receiver().value);
-      asset zeroTokens (0, symbol(m_symbol,4));
+      poolstable pools (get_self(), get_first_receiver().value);
+      auto poolIndex = pools.get_index<name("poolname")>();
+
+      //-- holder rewards dropped per pool, taken off the pools' hldrRewards at the end
+      std::map<uint64_t, int64_t> droppedRewards;
 
       auto itr = tblholderTknReqs.begin();
       
       while(itr != tblholderTknReqs.end())
       {
          auto hldrItr = holders.find(itr->holderID);
+         auto itrPool = poolIndex.find(hldrItr->poolName.value);
+         check( itrPool != poolIndex.end(), "Pool does not exist." );
+
+         droppedRewards[itrPool->ID] += hldrreward(*itrPool, *hldrItr);
+
          holders.modify(hldrItr, get_self(), [&]( auto& row ) {
-            row.remainingTokens.amount = row.tokens.amount;
-            row.availableReward = zeroTokens;
+            row.remainingTokens = row.tokens;
+            row.availableReward = 0;
+            row.rewardCheckpoint = itrPool->rewardPerToken;
          });
 
          itr = tblholderTknReqs.erase(itr);
       }
+
+      for (const auto& dropped : droppedRewards)
+      {
+         pools.modify(pools.find(dropped.first), get_self(), [&]( auto& row ) {
+            row.hldrRewards -= dropped.second;
+         });
+      }
+   }
+
+   void token::prunereqs(const uint64_t fromTID, const uint32_t minAge, const uint32_t maxRows)
+   {
+      require_auth( m_modihost );
+      check( maxRows > 0, "maxRows must be positive." );
+      check( minAge >= cfg().pruneMinAge && minAge <= m_maxPruneAge, "Invalid minAge." );
+
+      hotelFeeReqs tblhotelFeeReq(get_self(), get_first_receiver().value);
+      poolTokenReqs tblpoolTokenReqs(get_self(), get_first_receiver().value);
+      holderTknReqs tblholderTknReqs(get_self(), get_first_receiver().value);
+
+      auto poolReqIndex = tblpoolTokenReqs.get_index<name("tid")>();
+      auto hldrReqIndex = tblholderTknReqs.get_index<name("tid")>();
+
+      uint32_t budget = maxRows;
+      uint32_t tids = 0;
+      uint32_t poolRows = 0;
+      uint32_t hldrRows = 0;
+      uint64_t firstTID = 0;
+      uint64_t lastTID = 0;
+      asset totalTokens = m_zeroTokens;
+      asset feesTokens = m_zeroTokens;
+      asset rewardTokens = m_zeroTokens;
+
+      auto itr = tblhotelFeeReq.lower_bound(fromTID);
+
+      //-- every visited row costs budget, settled bookings also pay for their pool and holder rows
+      while (itr != tblhotelFeeReq.end() && budget > 0)
+      {
+         if (itr->isServiceProvided != 1 || now() - itr->createdDate < minAge) {
+            itr++;
+            budget--;
+            continue;
+         }
+
+         auto poolReqItr = poolReqIndex.lower_bound(itr->TID);
+         while (poolReqItr != poolReqIndex.end() && poolReqItr->TID == itr->TID && budget > 0) {
+            poolReqItr = poolReqIndex.erase(poolReqItr);
+            poolRows++;
+            budget--;
+         }
+
+         auto hldrReqItr = hldrReqIndex.lower_bound(itr->TID);
+         while (hldrReqItr != hldrReqIndex.end() && hldrReqItr->TID == itr->TID && budget > 0) {
+            hldrReqItr = hldrReqIndex.erase(hldrReqItr);
+            hldrRows++;
+            budget--;
+         }
+
+         //-- out of budget with rows left, the fee row stays so the next call resumes at this TID
+         if (budget == 0) {
+            break;
+         }
+
+         if (tids == 0) {
+            firstTID = itr->TID;
+         }
+
+         lastTID = itr->TID;
+         totalTokens += itr->totalTokens;
+         feesTokens += itr->feesTokens;
+         rewardTokens += itr->rewardTokens;
+         tids++;
+         budget--;
+
+         itr = tblhotelFeeReq.erase(itr);
+      }
+
+      //-- keep the pruned history in the action trace for indexers
+      if (tids > 0 || poolRows > 0 || hldrRows > 0) {
+         prunelog_action prunelog( get_self(), {get_self(), "active"_n} );
+         prunelog.send( firstTID, lastTID, tids, poolRows, hldrRows, totalTokens, feesTokens, rewardTokens );
+      }
+
+      //-- cursor for the next call
+      if (itr == tblhotelFeeReq.end()) {
+         print(" prune done ");
+      }
+      else {
+         print(" next ", itr->TID);
+      }
+   }
+
+   void token::prunelog(const uint64_t firstTID, const uint64_t lastTID, const uint32_t tids, const uint32_t poolRows,
+                        const uint32_t holderRows, const asset totalTokens, const asset feesTokens, const asset rewardTokens)
+   {
+      require_auth( get_self() );
+   }
+
+   void token::metrics(const name action, const work_counters counters)
+   {
+      require_auth( get_self() );
+   }
+
+   //-- (private) one work summary per action, in the action trace for off-chain analysis
+   void token::sendmetrics(const name& action)
+   {
+      metrics_action metrics( get_self(), {get_self(), "active"_n} );
+      metrics.send( action, m_work );
+      m_work = work_counters{};
+   }
+
+   void token::logevent(const std::vector<event_rec> events)
+   {
+      require_auth( get_self() );
+   }
+
+   //-- (private) queues one event, sendevents puts the queue in one logevent
+   void token::logev( const uint8_t kind, const uint64_t ref, const name pool, const name account,
+                      const int64_t tokens, const int64_t reward, const int64_t fees )
+   {
+      m_events.push_back({ kind, ref, pool, account, tokens, reward, fees });
+   }
+
+   void token::sendevents()
+   {
+      if (m_events.empty()) {
+         return;
+      }
+
+      logevent_action logevent( get_self(), {get_self(), "active"_n} );
+      logevent.send( m_events );
+      m_events.clear();
    }
 
    void token::dlttblstake(){
@@ -305,6 +510,7 @@ namespace eosio {
 
       auto itr = tblStakes.begin();
       while(itr != tblStakes.end()){
+         setstaked(itr->colateral, 0);
          itr = tblStakes.erase(itr);
       }
    }
@@ -326,19 +532,250 @@ namespace eosio {
       }
    }
 
+   //-- (private)
+   template<typename T>
+   uint64_t token::rebuildrows(T& table, const uint64_t fromID, const uint32_t maxRows)
+   {
+      auto itr = table.lower_bound(fromID);
+      uint32_t count = 0;
+
+      //-- erase and emplace the same row, emplace writes an entry in every secondary index
+      while(itr != table.end() && count < maxRows)
+      {
+         auto row = *itr;
+         itr = table.erase(itr);
+
+         table.emplace(get_self(), [&]( auto& r ) {
+            r = row;
+         });
+
+         count++;
+      }
+
+      return itr == table.end() ? std::numeric_limits<uint64_t>::max() : itr->primary_key();
+   }
+
+   void token::rbldindex(const name table, const uint64_t fromID, const uint32_t maxRows)
+   {
+      require_auth( m_modihost );
+      check( maxRows > 0, "maxRows must be positive." );
+
+      uint64_t nextID = std::numeric_limits<uint64_t>::max();
+
+      if (table == "poolholder2"_n) {
+         poolholders holders (get_self(), get_first_receiver().value);
+         nextID = rebuildrows(holders, fromID, maxRows);
+      }
+      else if (table == "pools2"_n) {
+         poolstable pools (get_self(), get_first_receiver().value);
+         nextID = rebuildrows(pools, fromID, maxRows);
+      }
+      else if (table == "pooltknlck2"_n) {
+         pooltknlocks tblPoolTknLocks (get_self(), get_first_receiver().value);
+         nextID = rebuildrows(tblPoolTknLocks, fromID, maxRows);
+      }
+      else if (table == "hldrtknlck2"_n) {
+         hldrtknlocks tblHldrTknLock (get_self(), get_first_receiver().value);
+         nextID = rebuildrows(tblHldrTknLock, fromID, maxRows);
+      }
+      else {
+         check(false, "Table has no index to rebuild.");
+      }
+
+      //-- cursor for the next call
+      if (nextID == std::numeric_limits<uint64_t>::max()) {
+         print(" rebuild done ");
+      }
+      else {
+         print(" next ", nextID);
+      }
+   }
+
+
+   void token::migratepools(const uint32_t maxRows)
+   {
+      require_auth( m_modihost );
+      check( maxRows > 0, "maxRows must be positive." );
+
+      poolstablev1 poolsv1 (get_self(), get_first_receiver().value);
+      poolTokenReqsv1 poolReqsv1 (get_self(), get_first_receiver().value);
+      poolstable pools (get_self(), get_first_receiver().value);
+      poolTokenReqs poolReqs (get_self(), get_first_receiver().value);
+
+      uint32_t rows = 0;
+
+      //-- highest ID first, like migratev2, addpool and bookings wait until every pool and booking leg is moved
+      while (poolsv1.begin() != poolsv1.end() && rows < maxRows)
+      {
+         auto itr = --poolsv1.end();
+
+         pool row{};
+         row.ID = itr->ID;
+         row.poolName = itr->poolName;
+         row.ownerAcnt = itr->ownerAcnt;
+         row.colaterlAcnt = itr->colaterlAcnt;
+         row.rewardAcnt = itr->rewardAcnt;
+         row.reward = pcttobps(itr->reward);
+         row.isPrivate = itr->isPrivate;
+         row.ownerShare = pcttobps(itr->ownerShare);
+         row.holderShare = pcttobps(itr->holderShare);
+         row.totalTokens = itr->totalTokens;
+         row.avlblTokens = itr->avlblTokens;
+         row.colaterlAmnt = itr->colaterlAmnt;
+         row.ownerAvlblReward = itr->ownerAvlblReward;
+         row.lockTime = itr->lockTime;
+         row.lockInSecs = itr->lockInSecs;
+         row.createdDate = itr->createdDate;
+         row.isActive = itr->isActive;
+         row.arRestriction = itr->arRestriction;
+
+         //-- baseline pools borrowed from their holders by last use
+         row.holderPolicy = m_plcyLru;
+
+         //-- holders' rewards so far are in their availableReward
+         row.rewardPerToken = 0;
+
+         pools.emplace(get_self(), [&]( auto& r ) {
+            r = row;
+         });
+
+         poolsv1.erase(itr);
+         rows++;
+      }
+
+      while (poolReqsv1.begin() != poolReqsv1.end() && rows < maxRows)
+      {
+         auto itr = --poolReqsv1.end();
+
+         poolReqs.emplace(get_self(), [&]( auto& row ) {
+            row.ID = itr->ID;
+            row.TID = itr->TID;
+            row.hotel = itr->hotel;
+            row.poolID = itr->poolID;
+            row.pool = itr->pool;
+            row.totalTokens = itr->totalTokens;
+            row.rewardPerc = pcttobps(itr->rewardPerc);
+            row.rewardTokens = itr->rewardTokens;
+            row.createdDate = itr->createdDate;
+            row.ownerRewardTokens = itr->ownerRewardTokens;
+         });
+
+         poolReqsv1.erase(itr);
+         rows++;
+      }
+
+      if (rows == maxRows) {
+         print(" rows left ");
+         return;
+      }
+
+      print(" migrate done ");
+   }
 
-   asset token::sqroot(asset number)
+   void token::migratev2(const uint32_t maxRows)
    {
-      asset temp (0, symbol(m_symbol,4));
-      asset sqrt (0, symbol(m_symbol,4));
+      require_auth( m_modihost );
+      check( maxRows > 0, "maxRows must be positive." );
+
+      //-- holders are counted in their pools2 rows
+      chkmigratepools();
+
+      poolholdersv1 holdersv1 (get_self(), get_first_receiver().value);
+      pooltknlocksv1 poolLocksv1 (get_self(), get_first_receiver().value);
+      hldrtknlocksv1 hldrLocksv1 (get_self(), get_first_receiver().value);
+      poolholders holders (get_self(), get_first_receiver().value);
+      pooltknlocks poolLocks (get_self(), get_first_receiver().value);
+      hldrtknlocks hldrLocks (get_self(), get_first_receiver().value);
+      poolstable pools (get_self(), get_first_receiver().value);
+      auto poolIndex = pools.get_index<name("poolname")>();
+
+      uint32_t rows = 0;
+
+      //-- highest ID first, so rows emplaced in v2 meanwhile never take an ID that is still to be moved
+      while (holdersv1.begin() != holdersv1.end() && rows < maxRows)
+      {
+         auto itr = --holdersv1.end();
+         auto itrPool = poolIndex.find(itr->poolName.value);
+         check( itrPool != poolIndex.end(), "Pool does not exist." );
+
+         //-- migratepools starts activeHolders and hldrRewards at 0, count the holder in
+         poolIndex.modify(itrPool, get_self(), [&]( auto& row ) {
+            row.activeHolders += itr->isActive ? 1 : 0;
+            row.hldrRewards += itr->availableReward.amount;
+         });
 
-      sqrt.amount = number.amount / 2;
+         holders.emplace(get_self(), [&]( auto& row ) {
+            row.ID = itr->ID;
+            row.poolName = itr->poolName;
+            row.holder = itr->holder;
+            row.tokens = itr->tokens.amount;
+            row.remainingTokens = itr->remainingTokens.amount;
+            row.availableReward = itr->availableReward.amount;
+            row.lastUsedAt = static_cast<uint32_t>(itr->lastUsedAt);
+            row.createdDate = itr->createdDate;
+            row.isActive = itr->isActive;
+            //-- the pool's rewardPerToken starts at 0 in pools2, all of it accrued on this holder's tokens
+            row.rewardCheckpoint = 0;
+         });
+
+         holdersv1.erase(itr);
+         rows++;
+      }
+
+      while (poolLocksv1.begin() != poolLocksv1.end() && rows < maxRows)
+      {
+         auto itr = --poolLocksv1.end();
+
+         poolLocks.emplace(get_self(), [&]( auto& row ) {
+            row.ID = itr->ID;
+            row.poolID = itr->poolID;
+            row.tokens = itr->tokens.amount;
+            row.lockedUntil = itr->lockedUntil;
+            row.createdDate = itr->createdDate;
+         });
+
+         poolLocksv1.erase(itr);
+         rows++;
+      }
+
+      while (hldrLocksv1.begin() != hldrLocksv1.end() && rows < maxRows)
+      {
+         auto itr = --hldrLocksv1.end();
+
+         hldrLocks.emplace(get_self(), [&]( auto& row ) {
+            row.ID = itr->ID;
+            row.holderID = itr->holderID;
+            row.tokens = itr->tokens.amount;
+            row.lockedUntil = itr->lockedUntil;
+            row.createdDate = itr->createdDate;
+         });
+
+         hldrLocksv1.erase(itr);
+         rows++;
+      }
+
+      if (rows == maxRows) {
+         print(" rows left ");
+         return;
+      }
 
-      while (sqrt.amount != temp.amount) {
-         temp.amount = sqrt.amount;
-         sqrt.amount = ( number.amount/temp.amount + temp.amount) / 2;
+      //-- locks moved from v1 were not in the unlock schedule yet
+      auto poolLockIndex = poolLocks.get_index<name("lockeduntil")>();
+      auto hldrLockIndex = hldrLocks.get_index<name("lockeduntil")>();
+      uint32_t unlockAt = 0;
+
+      if (poolLockIndex.begin() != poolLockIndex.end()) {
+         unlockAt = poolLockIndex.begin()->lockedUntil;
+      }
+      if (hldrLockIndex.begin() != hldrLockIndex.end() && (unlockAt == 0 || hldrLockIndex.begin()->lockedUntil < unlockAt)) {
+         unlockAt = hldrLockIndex.begin()->lockedUntil;
+      }
+
+      if (unlockAt > 0) {
+         schdlunlock(unlockAt);
       }
-      return sqrt * 100;
+
+      print(" migrate done ");
    }
 
 
@@ -349,6 +786,9 @@ namespace eosio {
       poolstable pools(get_self(), get_first_receiver().value);
       auto itr = pools.find(0);
 
+      chkshards();
+      chkmigratepools();
+
       if (itr == pools.end())
       {
          //-- check if pool has token balance
@@ -358,7 +798,7 @@ namespace eosio {
 
          //-- insert mainpool in pools table
          auto mainPoolBlnc = token::get_balance(get_self(), m_mainpool, symbol_code(m_symbol));
-         asset rewardTokens (0, symbol(m_symbol,4));
+         asset rewardTokens = m_zeroTokens;
 
          pools.emplace(get_self(), [&]( auto& row ) {
             row.ID = pools.available_primary_key();
@@ -366,9 +806,9 @@ namespace eosio {
             row.ownerAcnt = m_mainpool;
             row.colaterlAcnt = m_mainpool;
             row.rewardAcnt = m_mainpoolrwd;
-            row.reward = m_mainpoolrew;
+            row.reward = cfg().mainpoolReward;
             row.isPrivate = false;
-            row.ownerShare = 100;
+            row.ownerShare = m_bpsBase;
             row.holderShare = 0;
             row.totalTokens = mainPoolBlnc;
             row.avlblTokens = mainPoolBlnc;
@@ -378,12 +818,77 @@ namespace eosio {
             row.lockInSecs = 0;
             row.createdDate = now();
             row.isActive = true;
+            row.rewardPerToken = 0;
+            row.holderPolicy = m_plcyLru;
+            row.activeHolders = 0;
+            row.hldrRewards = 0;
          });
       }
    }
 
-   void token::addpool(name poolName, name ownerAcnt, name colaterlAcnt, name rewardAcnt, double reward, 
-                        bool isPrivate, double ownerShare, double holderShare, const asset pCollateral, std::vector<name> arRestriction) 
+   void token::setconfig(const config params)
+   {
+      require_auth( m_modihost );
+
+      check( params.modihostFees <= m_bpsBase, "Invalid fees." );
+      check( params.mainpoolReward <= m_bpsBase, "Invalid main pool reward." );
+      check( params.colateralAmount > 0, "Invalid collateral amount." );
+      check( params.lockCoef > 0, "Invalid lock coefficient." );
+      check( params.unlockRows > 0 && params.unlockRows <= m_maxUnlockRows, "Invalid unlockRows." );
+      check( params.lazyUnlockRows > 0 && params.lazyUnlockRows <= m_maxUnlockRows, "Invalid lazyUnlockRows." );
+      check( params.pruneMinAge <= m_maxPruneAge, "Invalid prune age." );
+      chkshards();
+
+      configs tblConfig(get_self(), get_first_receiver().value);
+      tblConfig.set(params, get_self());
+
+      m_cfg = params;
+      m_cfgLoaded = true;
+   }
+
+   //-- (private) tunable parameters, read from the config row once per action
+   const token::config& token::cfg()
+   {
+      if (!m_cfgLoaded) {
+         configs tblConfig(get_self(), get_first_receiver().value);
+         m_cfg = tblConfig.get_or_default( config{} );
+         m_cfgLoaded = true;
+      }
+      return m_cfg;
+   }
+
+   //-- (private) a missing shard account would fail every booking hashed to it, checked once at setup
+   void token::chkshards()
+   {
+      for (const auto& shard : m_escrowShards) {
+         check( is_account( shard ), "escrow shard account does not exist" );
+      }
+   }
+
+   //-- (private) pool and booking leg IDs still in v1 would collide with rows addpool and bookings emplace,
+   //-- so those wait for migratepools
+   void token::chkmigratepools()
+   {
+      poolstablev1 poolsv1 (get_self(), get_first_receiver().value);
+      poolTokenReqsv1 poolReqsv1 (get_self(), get_first_receiver().value);
+
+      check( poolsv1.begin() == poolsv1.end() && poolReqsv1.begin() == poolReqsv1.end(), "Run migratepools first." );
+   }
+
+   //-- (private) holder and lock IDs still in v1 would collide with rows v2 actions emplace, and v1 holders
+   //-- are invisible to them, so holder and booking actions wait for migratev2
+   void token::chkmigratev2()
+   {
+      poolholdersv1 holdersv1 (get_self(), get_first_receiver().value);
+      pooltknlocksv1 poolLocksv1 (get_self(), get_first_receiver().value);
+      hldrtknlocksv1 hldrLocksv1 (get_self(), get_first_receiver().value);
+
+      check( holdersv1.begin() == holdersv1.end() && poolLocksv1.begin() == poolLocksv1.end() &&
+             hldrLocksv1.begin() == hldrLocksv1.end(), "Run migratev2 first." );
+   }
+
+   void token::addpool(name poolName, name ownerAcnt, name colaterlAcnt, name rewardAcnt, uint64_t reward, 
+                        bool isPrivate, uint64_t ownerShare, uint64_t holderShare, const asset pCollateral, std::vector<name> arRestriction) 
    {
       check( is_account( poolName ), "pool account does not exist");
       check( is_account( ownerAcnt ), "owner account does not exist");
@@ -391,7 +896,10 @@ namespace eosio {
       check( is_account( rewardAcnt ), "reward account does not exist");
 
       poolstable pools(get_self(), get_first_receiver().value);
-      asset rewardTokens (0, symbol(m_symbol,4));
+      asset rewardTokens = m_zeroTokens;
+
+      //-- IDs and names of pools still in v1 are not in pools2 yet
+      chkmigratepools();
 
       auto itrP = pools.find(0);
       check(itrP != pools.end(), "Mainpool is not created in explorer yet.");
@@ -407,7 +915,9 @@ namespace eosio {
          check( item.colaterlAcnt != colaterlAcnt , "Collateral account already in use.");
       }
 
-      check( pCollateral.amount >= colateralAmount, "Invalid collateral amount." );
+      check( pCollateral.amount >= cfg().colateralAmount, "Invalid collateral amount." );
+      check( reward <= m_bpsBase, "Invalid reward." );
+      check( ownerShare + holderShare <= m_bpsBase, "Invalid reward shares." );
 
       //-- check if collateral has balance
       accounts accountstable ( get_self(), colaterlAcnt.value );
@@ -419,10 +929,7 @@ namespace eosio {
       check( blnc.amount >= pCollateral.amount, "Balance less than collateral amount." );
 
       //-- update pool lock time
-      asset collateral (pCollateral.amount, symbol(m_symbol,4));
-      asset coeficient (57000, symbol(m_symbol,4));
-      auto caRoot = sqroot(collateral);
-      auto lockInSecs = (coeficient.amount * 100000) / caRoot.amount;
+      auto lockInSecs = lockinsecs(pCollateral.amount);
 
       //-- insert in pools table
       pools.emplace(get_self(), [&]( auto& row ) {
@@ -442,8 +949,12 @@ namespace eosio {
          row.lockTime = now();
          row.lockInSecs = lockInSecs;
          row.createdDate = now();
-         row.arRestriction = arRestriction;
+         row.arRestriction = {};
          row.isActive = true;
+         row.rewardPerToken = 0;
+         row.holderPolicy = m_plcyLru;
+         row.activeHolders = 0;
+         row.hldrRewards = 0;
       });
 
       //-- lock collateral tokens
@@ -456,6 +967,19 @@ namespace eosio {
          row.createdDate = now();
          row.tokens = pCollateral;
       });
+
+      setstaked(colaterlAcnt, pCollateral.amount);
+
+      //-- restricted hotels
+      restrictions tblRestrictions(get_self(), poolName.value);
+
+      for (const auto& hotel : arRestriction) {
+         if (tblRestrictions.find(hotel.value) == tblRestrictions.end()) {
+            tblRestrictions.emplace(get_self(), [&]( auto& row ) {
+               row.hotel = hotel;
+            });
+         }
+      }
    }
 
    void token::addpoolholdr(name poolName, name holder, asset tokens)
@@ -463,6 +987,7 @@ namespace eosio {
       check( is_account( poolName ), "pool does not exist");
       check( is_account( holder ), "holder account does not exist");
       require_auth( holder );
+      chkmigratev2();
  
       poolstable pools(get_self(), get_first_receiver().value);
       poolholders holders(get_self(), get_first_receiver().value);
@@ -476,22 +1001,10 @@ namespace eosio {
 
 
       //-- check if holder already registered in this pool
-      auto hldrIndex = holders.get_index<name("holder")>();
-      auto itr = hldrIndex.find(holder.value);
-      auto isRegistered = false;
-      uint64_t hID;
-
-      //-- find the given pool in holder's registered pools
-      for (; itr != hldrIndex.end(); itr++)
-      {
-         if(itr->poolName == poolName && itr->holder == holder) {
-            isRegistered = true;
-            hID = itr->ID;
-            // check(1 == 0, "Holder already registered for this pool.");
-            // print( "Holder already registered for this pool." );
-            // return;
-         }
-      }
+      auto hldrIndex = holders.get_index<name("holderpool")>();
+      auto itr = hldrIndex.find(hldrpoolkey(holder, poolName));
+      auto isRegistered = itr != hldrIndex.end();
+      uint64_t hID = isRegistered ? itr->ID : 0;
 
       //-- check if it has balance
       accounts accountstable ( get_self(), holder.value );
@@ -506,42 +1019,46 @@ namespace eosio {
       token::transfer(holder, poolName, tokens, "holder to pool");
 
       //-- insert in poolholders table
-      if(isRegistered == false){
-         asset rewardTokens (0, symbol(m_symbol,4));
+      int32_t newHolders = 1;
 
+      if(isRegistered == false){
          holders.emplace(get_self(), [&]( auto& row ) {
             row.ID = holders.available_primary_key();
             row.poolName = poolName;
             row.holder = holder;
-            row.tokens = tokens;
-            row.remainingTokens = tokens;
-            row.availableReward = rewardTokens;
+            row.tokens = tokens.amount;
+            row.remainingTokens = tokens.amount;
+            row.availableReward = 0;
             row.lastUsedAt = now();
             row.createdDate = now();
             row.isActive = true;
+            row.rewardCheckpoint = itrPool->rewardPerToken;
          });
       }
       else {
          auto itrr = holders.find(hID);
+         newHolders = itrr->isActive ? 0 : 1;
+
          holders.modify(itrr, get_self(), [&]( auto& row ) {
+            accruereward(*itrPool, row);
             row.isActive = true;
-            row.tokens = row.tokens + tokens;
-            row.remainingTokens = row.remainingTokens + tokens;
+            row.tokens += tokens.amount;
+            row.remainingTokens += tokens.amount;
          });
       }
 
       //-- update pool total tokens
-      updpoltottkn(itrPool->poolName, itrPool->ID, tokens, true);
+      updpoltottkn(itrPool->ID, tokens, true, newHolders, 0);
    }
 
 
    void token::leavepool(const name poolName, const name holder)
    {
       require_auth( holder );
+      chkmigratev2();
 
       poolholders holders (get_self(), get_first_receiver().value);
       poolstable pools (get_self(), get_first_receiver().value);
-      asset zeroTokens (0, symbol(m_symbol,4));
  
       //-- check if pool exists
       auto poolIndex = pools.get_index<name("poolname")>();
@@ -550,64 +1067,64 @@ namespace eosio {
       check(itrPool != poolIndex.end(), "Pool not found.");
       check(itrPool->isActive == true, "Pool is terminated.");
 
-      auto hldrIndex = holders.get_index<name("holder")>();
-      auto itr = hldrIndex.find(holder.value);
-      asset tokens;
-
       //-- find the given pool in holder's registered pools
-      for (; itr != hldrIndex.end(); itr++)
-      {
-         if(itr->poolName == poolName && itr->holder == holder)
-         {
-            //-- chk if holder active
-            check( itr->isActive == true , "Holder already terminated." );
-            tokens = itr->tokens;
+      auto hldrIndex = holders.get_index<name("holderpool")>();
+      auto itr = hldrIndex.find(hldrpoolkey(holder, poolName));
+      check( itr != hldrIndex.end() , "Holder not registered in this pool." );
 
-            //-- check if tokens are free and not locked
-            check( itr->remainingTokens == itr->tokens , "Tokens currently locked or in use." );
+      //-- release expired locks first, the unlock timer may not have run yet
+      reclaimpool(pools, itrPool->ID, cfg().lazyUnlockRows);
+      reclaimholder(holders, itr->ID, cfg().lazyUnlockRows);
 
-            if(itr->tokens.amount > 0) {
-               //-- check pool has required tokens
-               auto poolBlnc = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
-               check( poolBlnc.amount >= itr->tokens.amount, "Insufficient pool balance." );
-            
-               //-- transfer total tokens to holder
-               token::transfer2Esc(poolName, holder, itr->tokens, "Transfer from pool to holder.");
-            }
+      //-- chk if holder active
+      check( itr->isActive == true , "Holder already terminated." );
+      asset tokens = tknasset(itr->tokens);
 
-            if(itr->availableReward.amount > 0) {
-               //-- check reward account has required tokens
-               auto poolIndex = pools.get_index<name("poolname")>();
-               auto itrPool = poolIndex.find(poolName.value);
+      //-- check if tokens are free and not locked
+      check( hldrlocked(*itrPool, *itr) == 0 , "Tokens currently locked or in use." );
 
-               auto rwrdBlnc = token::get_balance(get_self(), itrPool->rewardAcnt, symbol_code(m_symbol));
-               check( rwrdBlnc.amount >= itr->availableReward.amount, "Insufficient reward account balance." );
+      if(tokens.amount > 0) {
+         //-- check pool has required tokens
+         auto poolBlnc = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
+         check( poolBlnc.amount >= tokens.amount, "Insufficient pool balance." );
+      
+         //-- transfer total tokens to holder
+         token::transfer2Esc(poolName, holder, tokens, "Transfer from pool to holder.");
+      }
 
-               //-- transfer reward tokens to holder
-               token::transfer2Esc(itrPool->rewardAcnt, holder, itr->availableReward, "Transfer from reward to holder.");
-            }
+      asset reward = tknasset(hldrreward(*itrPool, *itr));
 
-            //-- inactivate holder
-            auto hldrTblItr = holders.find(itr->ID);
+      if(reward.amount > 0) {
+         //-- check reward account has required tokens
+         auto rwrdBlnc = token::get_balance(get_self(), itrPool->rewardAcnt, symbol_code(m_symbol));
+         check( rwrdBlnc.amount >= reward.amount, "Insufficient reward account balance." );
 
-            holders.modify(hldrTblItr, get_self(), [&]( auto& row ) {
-               row.isActive = false;
-               row.availableReward = zeroTokens;
-               row.tokens = zeroTokens;
-               row.remainingTokens = zeroTokens;
-            });
+         //-- transfer reward tokens to holder
+         token::transfer2Esc(itrPool->rewardAcnt, holder, reward, "Transfer from reward to holder.");
+      }
 
-            //-- update pool total tokens
-            updpoltottkn(itrPool->poolName, itrPool->ID, tokens, false);
+      //-- inactivate holder
+      auto hldrTblItr = holders.find(itr->ID);
 
-            break;
-         }
-      }
+      holders.modify(hldrTblItr, get_self(), [&]( auto& row ) {
+         row.isActive = false;
+         row.availableReward = 0;
+         row.tokens = 0;
+         row.remainingTokens = 0;
+         row.rewardCheckpoint = itrPool->rewardPerToken;
+      });
+
+      //-- update pool total tokens
+      updpoltottkn(itrPool->ID, tokens, false, -1, reward.amount);
+
+      logev(m_evHldrReward, itr->ID, poolName, holder, tokens.amount, reward.amount, 0);
+      sendevents();
    }
 
    void token::lendmoretkns(const name poolName, const name holder, const asset tokens)
    {
       require_auth( holder );
+      chkmigratev2();
 
       poolstable pools(get_self(), get_first_receiver().value);
       poolholders holders(get_self(), get_first_receiver().value);
@@ -620,24 +1137,12 @@ namespace eosio {
       check(itrPool->isActive == true, "Pool is terminated.");
 
       //-- check if holder is registered in this pool
-      auto hldrIndex = holders.get_index<name("holder")>();
-      auto itr = hldrIndex.find(holder.value);
-      bool isRegistered = false;
-      uint64_t holderID;
-      bool isActive;
-
-      //-- find the given pool in holder's registered pools
-      for (; itr != hldrIndex.end(); itr++)
-      {
-         if(itr->poolName == poolName && itr->holder == holder) {
-            isRegistered = true;
-            holderID = itr->ID;
-            isActive = itr->isActive;
-         }
-      }
+      auto hldrIndex = holders.get_index<name("holderpool")>();
+      auto itr = hldrIndex.find(hldrpoolkey(holder, poolName));
       
-      check(isRegistered == true, "Holder not registered in this pool.");
-      check(isActive == true, "Holder not registered in this pool.");
+      check(itr != hldrIndex.end(), "Holder not registered in this pool.");
+      check(itr->isActive == true, "Holder not registered in this pool.");
+      uint64_t holderID = itr->ID;
 
 
       //-- check if holder has balance
@@ -657,15 +1162,16 @@ namespace eosio {
       auto itrHld = holders.find(holderID);
 
       holders.modify(itrHld, get_self(), [&]( auto& row ) {
-         row.tokens = row.tokens + tokens;
-         row.remainingTokens = row.remainingTokens + tokens;
+         accruereward(*itrPool, row);
+         row.tokens += tokens.amount;
+         row.remainingTokens += tokens.amount;
       });
 
       //-- update pool total tokens
-      updpoltottkn(itrPool->poolName, itrPool->ID, tokens, true);
+      updpoltottkn(itrPool->ID, tokens, true, 0, 0);
    }
 
-   void token::chngepoolfee(const name poolName, const double reward)
+   void token::chngepoolfee(const name poolName, const uint64_t reward)
    {
       //-- check if pool exists
       poolstable pools(get_self(), get_first_receiver().value);
@@ -677,6 +1183,7 @@ namespace eosio {
 
       //-- check if pool owner is logged in
       require_auth( itr->ownerAcnt );
+      check( reward <= m_bpsBase, "Invalid reward." );
 
       auto poolItr = pools.find(itr->ID);
       
@@ -685,122 +1192,259 @@ namespace eosio {
       });
    }
 
-   void token::trminatepool(const name poolName)
+   void token::sethldrplcy(const name poolName, const uint8_t policy)
    {
-      poolstable pools(get_self(), get_first_receiver().value);
-      poolholders holders (get_self(), get_first_receiver().value);
+      chkmigratev2();
 
       //-- check if pool exists
+      poolstable pools(get_self(), get_first_receiver().value);
       auto poolIndex = pools.get_index<name("poolname")>();
       auto itr = poolIndex.find(poolName.value);
       
       check(itr != poolIndex.end(), "Pool does not exist.");
-      check(itr->isActive == true, "Pool already terminated.");
+      check(itr->isActive == true, "Pool is terminated.");
 
       //-- check if pool owner is logged in
       require_auth( itr->ownerAcnt );
+      check( policy == m_plcyLru || policy == m_plcyProRata || policy == m_plcyLargest, "Invalid holder policy." );
 
+      //-- release expired locks first, the unlock timer may not have run yet
+      reclaimpool(pools, itr->ID, cfg().lazyUnlockRows);
 
-      //-- if no amount
-      accounts accountstable ( get_self(), poolName.value );
-      const auto& ac = accountstable.find( m_symbol.raw() );
+      //-- holders' locked tokens are tracked differently per policy, switch only when nothing is locked
+      check( itr->avlblTokens == itr->totalTokens, "Pool tokens locked or in use." );
 
-      if( ac == accountstable.end() ) {
-         auto poolItr = pools.find(itr->ID);
-         
-         pools.modify(poolItr, get_self(), [&]( auto& row ) {
-            row.isActive = false;
-            row.ownerAvlblReward = m_zeroTokens;
-            row.totalTokens = m_zeroTokens;
-            row.avlblTokens = m_zeroTokens;
-         });
-      }
-      else {
-         //-- check if any tokens in use
-         uint64_t totHoldersBlnc = 0;
-         uint64_t totHoldersRwrd = 0;
-         asset zeroTokens (0, symbol(m_symbol,4));
+      //-- every pool lock is gone, so the holder locks the bounded reclaims left are expired too, release all of them,
+      //-- pro-rata would ignore them and releasing them later would inflate remainingTokens
+      poolholders holders (get_self(), get_first_receiver().value);
+      auto hldrIndex = holders.get_index<name("poolid")>();
+
+      for (auto hldrItr = hldrIndex.lower_bound(hldrpoolidkey(poolName, 0)); hldrItr != hldrIndex.end() && hldrItr->poolName == poolName; hldrItr++)
+      {
+         reclaimholder(holders, hldrItr->ID, std::numeric_limits<uint32_t>::max());
+         check( hldrItr->remainingTokens == hldrItr->tokens, "Holder tokens locked or in use." );
+      }
+
+      auto poolItr = pools.find(itr->ID);
+      
+      pools.modify(poolItr, get_self(), [&]( auto& row ) {
+         row.holderPolicy = policy;
+      });
+
+      sendevents();
+   }
+
+   void token::setrestrict(const name poolName, const name hotel, const bool isRestricted)
+   {
+      //-- check if pool exists
+      poolstable pools(get_self(), get_first_receiver().value);
+      auto poolIndex = pools.get_index<name("poolname")>();
+      auto itr = poolIndex.find(poolName.value);
+      
+      check(itr != poolIndex.end(), "Pool does not exist.");
+      check(itr->isActive == true, "Pool is terminated.");
+
+      //-- check if pool owner is logged in
+      require_auth( itr->ownerAcnt );
+      check( itr->arRestriction.empty(), "Run mvrestrict for this pool first." );
+
+      restrictions tblRestrictions(get_self(), poolName.value);
+      auto itrRestrict = tblRestrictions.find(hotel.value);
 
-         auto hldrIndex = holders.get_index<name("poolname")>();
-         auto hldrItr = hldrIndex.find(poolName.value);
+      if (isRestricted) {
+         check( itrRestrict == tblRestrictions.end(), "Hotel already restricted." );
          
-         for (; hldrItr != hldrIndex.end(); hldrItr++)
-         {
-            if(hldrItr->poolName == poolName)
-            {
-               if(hldrItr->isActive != true) {
-                  continue;
-               }  
-
-               check( hldrItr->remainingTokens == hldrItr->tokens , "Pool tokens locked or in use." );
-               
-               totHoldersBlnc = totHoldersBlnc + hldrItr->tokens.amount;
-               totHoldersRwrd = totHoldersRwrd + hldrItr->availableReward.amount;
-            }
+         tblRestrictions.emplace(get_self(), [&]( auto& row ) {
+            row.hotel = hotel;
+         });
+      }
+      else {
+         check( itrRestrict != tblRestrictions.end(), "Hotel not restricted." );
+         tblRestrictions.erase(itrRestrict);
+      }
+   }
+
+   void token::mvrestrict(const name poolName)
+   {
+      require_auth( m_modihost );
+
+      poolstable pools(get_self(), get_first_receiver().value);
+      auto poolIndex = pools.get_index<name("poolname")>();
+      auto itr = poolIndex.find(poolName.value);
+      
+      check(itr != poolIndex.end(), "Pool does not exist.");
+
+      restrictions tblRestrictions(get_self(), poolName.value);
+
+      for (const auto& hotel : itr->arRestriction) {
+         if (tblRestrictions.find(hotel.value) == tblRestrictions.end()) {
+            tblRestrictions.emplace(get_self(), [&]( auto& row ) {
+               row.hotel = hotel;
+            });
          }
+      }
+
+      auto poolItr = pools.find(itr->ID);
+      
+      pools.modify(poolItr, get_self(), [&]( auto& row ) {
+         row.arRestriction = {};
+      });
+   }
+
+   void token::trminatepool(const name poolName, const uint32_t maxRows)
+   {
+      check( maxRows > 0, "maxRows must be positive." );
+      chkmigratev2();
+
+      poolstable pools(get_self(), get_first_receiver().value);
+      poolholders holders (get_self(), get_first_receiver().value);
+      trmntstates states (get_self(), get_first_receiver().value);
+
+      //-- check if pool exists
+      auto poolIndex = pools.get_index<name("poolname")>();
+      auto itr = poolIndex.find(poolName.value);
+      
+      check(itr != poolIndex.end(), "Pool does not exist.");
+
+      //-- check if pool owner is logged in
+      require_auth( itr->ownerAcnt );
+
+      //-- release expired locks first, the unlock timer may not have run yet
+      reclaimpool(pools, itr->ID, cfg().lazyUnlockRows);
 
-         if (totHoldersBlnc > 0) {
+      auto itrState = states.find(poolName.value);
+      auto poolItr = pools.find(itr->ID);
+
+      if (itrState == states.end()) {
+         check(itr->isActive == true, "Pool already terminated.");
+
+         //-- if no amount
+         accounts accountstable ( get_self(), poolName.value );
+         const auto& ac = accountstable.find( m_symbol.raw() );
+
+         if( ac == accountstable.end() ) {
+            pools.modify(poolItr, get_self(), [&]( auto& row ) {
+               row.isActive = false;
+               row.ownerAvlblReward = m_zeroTokens;
+               row.totalTokens = m_zeroTokens;
+               row.avlblTokens = m_zeroTokens;
+            });
+
+            sendevents();
+            return;
+         }
+
+         //-- check if any tokens in use
+         check( itr->avlblTokens == itr->totalTokens, "Pool tokens locked or in use." );
+
+         if (itr->totalTokens.amount > 0) {
             auto poolBlnc = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
-            check( poolBlnc.amount >= totHoldersBlnc , "Insufficient pool balance." );
+            check( poolBlnc.amount >= itr->totalTokens.amount , "Insufficient pool balance." );
          }
 
-         if ((totHoldersRwrd + itr->ownerAvlblReward.amount) > 0) {
+         if ((itr->hldrRewards + itr->ownerAvlblReward.amount) > 0) {
             auto rwrdAcntBlnc = token::get_balance(get_self(), itr->rewardAcnt, symbol_code(m_symbol));
-            check( rwrdAcntBlnc.amount >= (totHoldersRwrd + itr->ownerAvlblReward.amount) , "Insufficient reward account balance." );
+            check( rwrdAcntBlnc.amount >= (itr->hldrRewards + itr->ownerAvlblReward.amount) , "Insufficient reward account balance." );
          }
 
-         //-- transfer blnces and rewards to holders
-         hldrItr = hldrIndex.find(poolName.value);
+         //-- freeze the pool, no bookings or holder changes while holders are paid out
+         pools.modify(poolItr, get_self(), [&]( auto& row ) {
+            row.isActive = false;
+         });
 
-         for (; hldrItr != hldrIndex.end(); hldrItr++)
-         {
-            if(hldrItr->isActive != true) {
-               continue;
-            }
-            
-            if(hldrItr->poolName == poolName) 
-            {
-               if (hldrItr->tokens.amount > 0) {
-                  token::transfer2Esc(poolName, hldrItr->holder, hldrItr->tokens, "Transfer from pool to holder.");
-               }
-               if (hldrItr->availableReward.amount > 0) {
-                  token::transfer2Esc(itr->rewardAcnt, hldrItr->holder, hldrItr->availableReward, "Transfer from reward to holder.");
-               }
-
-               //-- inactivate holder
-               auto hldrTblItr = holders.find(hldrItr->ID);
-
-               holders.modify(hldrTblItr, get_self(), [&]( auto& row ) {
-                  row.availableReward = zeroTokens;
-                  row.tokens = zeroTokens;
-                  row.remainingTokens = zeroTokens;
-               });
-            }
+         itrState = states.emplace(get_self(), [&]( auto& row ) {
+            row.poolName = poolName;
+            row.cursor = 0;
+            row.startedAt = now();
+         });
+      }
+
+      //-- transfer blnces and rewards to at most maxRows holders, the pool's holder rows bound the walk,
+      //-- activeHolders is only kept up to date
+      auto hldrIndex = holders.get_index<name("poolid")>();
+      auto hldrItr = hldrIndex.lower_bound(hldrpoolidkey(poolName, itrState->cursor));
+      uint32_t count = 0;
+      uint32_t activeLeft = itr->activeHolders;
+      int64_t rewardsPaid = 0;
+
+      for (; hldrItr != hldrIndex.end() && hldrItr->poolName == poolName && count < maxRows; hldrItr++, count++)
+      {
+         if(hldrItr->isActive != true) {
+            continue;
+         }
+
+         activeLeft -= activeLeft > 0 ? 1 : 0;
+
+         reclaimholder(holders, hldrItr->ID, cfg().lazyUnlockRows);
+         check( hldrlocked(*itr, *hldrItr) == 0 , "Pool tokens locked or in use." );
+
+         if (hldrItr->tokens > 0) {
+            token::transfer2Esc(poolName, hldrItr->holder, tknasset(hldrItr->tokens), "Transfer from pool to holder.");
          }
+         asset reward = tknasset(hldrreward(*itr, *hldrItr));
 
-         //-- send owner reward and inactivate pool
-         auto poolItr = pools.find(itr->ID);
-         if (itr->ownerAvlblReward.amount > 0) {
-            token::transfer2Esc(itr->rewardAcnt, itr->ownerAcnt, itr->ownerAvlblReward, "Transfer from reward to owner.");
+         if (reward.amount > 0) {
+            token::transfer2Esc(itr->rewardAcnt, hldrItr->holder, reward, "Transfer from reward to holder.");
+            rewardsPaid += reward.amount;
          }
-         
-         auto blncPool = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
+         logev(m_evHldrReward, hldrItr->ID, poolName, hldrItr->holder, hldrItr->tokens, reward.amount, 0);
 
+         //-- inactivate holder
+         auto hldrTblItr = holders.find(hldrItr->ID);
+
+         holders.modify(hldrTblItr, get_self(), [&]( auto& row ) {
+            row.availableReward = 0;
+            row.tokens = 0;
+            row.remainingTokens = 0;
+            row.rewardCheckpoint = itr->rewardPerToken;
+         });
+      }
+
+      //-- more holders left, store the cursor for the next call
+      if (hldrItr != hldrIndex.end() && hldrItr->poolName == poolName) {
          pools.modify(poolItr, get_self(), [&]( auto& row ) {
-            row.isActive = false;
-            row.ownerAvlblReward = zeroTokens;
-            row.totalTokens = blncPool;
-            row.avlblTokens = m_zeroTokens;
+            row.activeHolders = activeLeft;
+            row.hldrRewards -= rewardsPaid;
          });
 
-         //-- unlock collateral
-         stakes tblstakes(get_self(), get_first_receiver().value);
-         auto itrStakes = tblstakes.find(itr->colaterlAcnt.value);
-         
-         if(itrStakes != tblstakes.end()){
-            tblstakes.erase(itrStakes);
-         }
+         states.modify(itrState, get_self(), [&]( auto& row ) {
+            row.cursor = hldrItr->ID;
+         });
+
+         sendevents();
+         print(" next ", hldrItr->ID);
+         return;
+      }
+
+      //-- send owner reward and close pool
+      if (itr->ownerAvlblReward.amount > 0) {
+         token::transfer2Esc(itr->rewardAcnt, itr->ownerAcnt, itr->ownerAvlblReward, "Transfer from reward to owner.");
+         logev(m_evOwnrReward, itr->ID, poolName, itr->ownerAcnt, 0, itr->ownerAvlblReward.amount, 0);
       }
+      
+      auto blncPool = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
+
+      pools.modify(poolItr, get_self(), [&]( auto& row ) {
+         row.ownerAvlblReward = m_zeroTokens;
+         row.totalTokens = blncPool;
+         row.avlblTokens = m_zeroTokens;
+         row.activeHolders = 0;
+         row.hldrRewards -= rewardsPaid;
+      });
+
+      states.erase(itrState);
+
+      //-- unlock collateral
+      stakes tblstakes(get_self(), get_first_receiver().value);
+      auto itrStakes = tblstakes.find(itr->colaterlAcnt.value);
+      
+      if(itrStakes != tblstakes.end()){
+         tblstakes.erase(itrStakes);
+         setstaked(itr->colaterlAcnt, 0);
+      }
+
+      sendevents();
+      print(" terminate done ");
    }
    
 
@@ -815,7 +1459,7 @@ namespace eosio {
          // action to invoke
          "unlkpooltkns"_n,
          // arguments for the action
-         std::make_tuple()
+         std::make_tuple(cfg().unlockRows)
       );
 
       // set delay in seconds
@@ -827,226 +1471,759 @@ namespace eosio {
       // with this senderId should be replaced
       // if set to false and this senderId already exists
       // this action will fail
-      print(sender_id);
-      t.send(sender_id, get_self() /*, false */);
+      t.send(sender_id, get_self(), true);
+
+      MH_PRINT(" Scheduled with a delay of ", delay);
+   }
+
+   //-- (private)
+   void token::schdlunlock(const uint32_t unlockAt)
+   {
+      unlocktimers tblTimer(get_self(), get_first_receiver().value);
+      auto timer = tblTimer.get_or_default();
+
+      //-- in-flight unlock already runs before this lock expires
+      if (timer.nextUnlockAt > now() && timer.nextUnlockAt <= unlockAt) {
+         return;
+      }
 
-      print(" Scheduled with a delay of ", delay);
+      timer.nextUnlockAt = unlockAt;
+      timer.scheduledAt = now();
+      tblTimer.set(timer, get_self());
+
+      //-- single sender id, so a new schedule replaces the in-flight transaction
+      calldeferred(unlockAt > now() ? unlockAt - now() : 0, m_modihost.value);
+   }
+
+   void token::unlkpooltkns(const uint32_t maxRows)
+   {
+      //-- the deferred unlock runs as the contract, anyone else could keep rescheduling it at the contract's expense
+      require_auth( get_self() );
+      check( maxRows > 0, "maxRows must be positive." );
+
+      reclaimexpired(maxRows);
+
+
+      //-- SCHEDULE NEXT UNLOCK for the earliest lock left (immediately if the budget ran out)
+      pooltknlocks tblPoolTknLocks (get_self(), get_first_receiver().value);
+      hldrtknlocks tblHldrTknLock (get_self(), get_first_receiver().value);
+      unlocktimers tblTimer(get_self(), get_first_receiver().value);
+      tblTimer.remove();
+
+      auto poolLockIndex = tblPoolTknLocks.get_index<name("lockeduntil")>();
+      auto hldrLockIndex = tblHldrTknLock.get_index<name("lockeduntil")>();
+      auto itr = poolLockIndex.begin();
+      auto itr2 = hldrLockIndex.begin();
+      uint32_t unlockAt = 0;
+      
+      if (itr != poolLockIndex.end()) {
+         unlockAt = itr->lockedUntil;
+      }
+      if (itr2 != hldrLockIndex.end() && (unlockAt == 0 || itr2->lockedUntil < unlockAt)) {
+         unlockAt = itr2->lockedUntil;
+      }
+
+      if (unlockAt > 0) {
+         schdlunlock(unlockAt);
+      }
+
+      sendevents();
+      MH_EMIT(name("unlkpooltkns"));
    }
 
-   void token::unlkpooltkns()
+   //-- (private) releases expired locks of all pools, oldest first, at most maxRows rows, returns the rows released
+   uint32_t token::reclaimexpired(const uint32_t maxRows)
    {
       poolstable pools(get_self(), get_first_receiver().value);
       pooltknlocks tblPoolTknLocks (get_self(), get_first_receiver().value);
       poolholders holders (get_self(), get_first_receiver().value);
       hldrtknlocks tblHldrTknLock (get_self(), get_first_receiver().value);
 
-      //-- UNLOCK POOL TOKENS
-      auto itr = tblPoolTknLocks.begin();
+      uint32_t rows = 0;
+
+      //-- UNLOCK POOL TOKENS (oldest lock first, stop at first lock not yet expired)
+      auto poolLockIndex = tblPoolTknLocks.get_index<name("lockeduntil")>();
+      auto itr = poolLockIndex.begin();
+
+      while(itr != poolLockIndex.end() && itr->lockedUntil <= now() && rows < maxRows)
+      {
+         auto poolItr = pools.find(itr->poolID);
+         MH_COUNT(rowsRead, 2);
+   
+         //-- add in available tokens
+         pools.modify(poolItr, get_self(), [&]( auto& row ) {
+            row.avlblTokens.amount = row.avlblTokens.amount + itr->tokens;
+         });
+         logev(m_evUnlock, itr->ID, poolItr->poolName, name(), itr->tokens, 0, 0);
+         
+         //-- dlt lock entry
+         itr = poolLockIndex.erase(itr);
+         rows++;
+         MH_COUNT(rowsModified, 1);
+         MH_COUNT(rowsErased, 1);
+      }
+
+
+      //-- UNLOCK HOLDER TOKENS (oldest lock first, stop at first lock not yet expired)
+      auto hldrLockIndex = tblHldrTknLock.get_index<name("lockeduntil")>();
+      auto itr2 = hldrLockIndex.begin();
+
+      while(itr2 != hldrLockIndex.end() && itr2->lockedUntil <= now() && rows < maxRows)
+      {
+         auto holderItr = holders.find(itr2->holderID);
+         MH_COUNT(rowsRead, 2);
+         MH_PRINT(" unlocked ", holderItr->poolName, holderItr->holder, itr2->tokens, " -- ");
+   
+         //-- add in available tokens
+         holders.modify(holderItr, get_self(), [&]( auto& row ) {
+            row.remainingTokens += itr2->tokens;
+         });
+         logev(m_evUnlock, itr2->ID, holderItr->poolName, holderItr->holder, itr2->tokens, 0, 0);
+         
+         //-- dlt lock entry
+         itr2 = hldrLockIndex.erase(itr2);
+         rows++;
+         MH_COUNT(rowsModified, 1);
+         MH_COUNT(rowsErased, 1);
+      }
+
+      return rows;
+   }
+
+   //-- (private) erases expired locks of one pool, at most maxRows rows, returns the tokens they held
+   int64_t token::rlspoollocks(pooltknlocks& locks, const pool& pool, const uint32_t maxRows)
+   {
+      auto lockIndex = locks.get_index<name("poolexpiry")>();
+      auto itr = lockIndex.lower_bound(lockexpirykey(pool.ID, 0));
+      uint32_t rows = 0;
+      int64_t tokens = 0;
+
+      while(itr != lockIndex.end() && itr->pkpoolexpiry() <= lockexpirykey(pool.ID, now()) && rows < maxRows)
+      {
+         tokens += itr->tokens;
+         logev(m_evUnlock, itr->ID, pool.poolName, name(), itr->tokens, 0, 0);
+
+         itr = lockIndex.erase(itr);
+         rows++;
+         MH_COUNT(rowsErased, 1);
+      }
+
+      return tokens;
+   }
+
+   //-- (private) erases expired locks of one holder, at most maxRows rows, returns the tokens they held
+   int64_t token::rlshldrlocks(hldrtknlocks& locks, const poolholder& holder, const uint32_t maxRows)
+   {
+      auto lockIndex = locks.get_index<name("hldrexpiry")>();
+      auto itr = lockIndex.lower_bound(lockexpirykey(holder.ID, 0));
+      uint32_t rows = 0;
+      int64_t tokens = 0;
+
+      while(itr != lockIndex.end() && itr->pkhldrexpiry() <= lockexpirykey(holder.ID, now()) && rows < maxRows)
+      {
+         tokens += itr->tokens;
+         logev(m_evUnlock, itr->ID, holder.poolName, holder.holder, itr->tokens, 0, 0);
+
+         itr = lockIndex.erase(itr);
+         rows++;
+         MH_COUNT(rowsErased, 1);
+      }
+
+      return tokens;
+   }
+
+   //-- (private) releases expired locks of one pool through the action's pools handle, at most maxRows rows,
+   //-- call before the action reads the pool's tokens
+   void token::reclaimpool(poolstable& pools, const uint64_t poolID, const uint32_t maxRows)
+   {
+      pooltknlocks tblPoolTknLocks (get_self(), get_first_receiver().value);
+
+      auto poolItr = pools.find(poolID);
+      auto tokens = rlspoollocks(tblPoolTknLocks, *poolItr, maxRows);
+
+      //-- one pool write for all released locks
+      if (tokens > 0) {
+         pools.modify(poolItr, get_self(), [&]( auto& row ) {
+            row.avlblTokens.amount += tokens;
+         });
+         MH_COUNT(rowsModified, 1);
+      }
+   }
+
+   //-- (private) releases expired locks of one holder through the action's holders handle, at most maxRows rows,
+   //-- call before the action reads the holder's tokens
+   void token::reclaimholder(poolholders& holders, const uint64_t holderID, const uint32_t maxRows)
+   {
+      hldrtknlocks tblHldrTknLock (get_self(), get_first_receiver().value);
+
+      auto hldrItr = holders.find(holderID);
+      auto tokens = rlshldrlocks(tblHldrTknLock, *hldrItr, maxRows);
+
+      //-- one holder write for all released locks
+      if (tokens > 0) {
+         holders.modify(hldrItr, get_self(), [&]( auto& row ) {
+            row.remainingTokens += tokens;
+         });
+         MH_COUNT(rowsModified, 1);
+      }
+   }
+
+   //-- (private) releases expired locks of one pool in the cache, flush writes the pool
+   void token::reclaimpool(tblcache& cache, const uint64_t poolID, const uint32_t maxRows)
+   {
+      auto tokens = rlspoollocks(cache.poolTknLock, cache.getpool(poolID), maxRows);
+
+      if (tokens > 0) {
+         cache.modpool(poolID).avlblTokens.amount += tokens;
+      }
+   }
+
+   //-- (private) releases expired locks of one holder in the cache, flush writes the holder
+   void token::reclaimholder(tblcache& cache, const uint64_t holderID, const uint32_t maxRows)
+   {
+      auto tokens = rlshldrlocks(cache.hldrTknLock, cache.getholder(holderID), maxRows);
+
+      if (tokens > 0) {
+         cache.modholder(holderID).remainingTokens += tokens;
+      }
+   }
+
+
+   //-- (private) table cache
+   token::tblcache::tblcache(const name& self, const uint64_t scope, const symbol_code& sym) :
+      self(self), scope(scope), sym(sym), tknSymbol(sym, 4), statstable(self, sym.raw()),
+      hotelFeeReq(self, scope), pools(self, scope), poolTokenReq(self, scope), poolTknLock(self, scope),
+      holders(self, scope), hldrTknLock(self, scope), escrowFee(self, scope)
+   {
+   }
+
+   const token::tblcache::balancerow& token::tblcache::getbalance(const name& owner)
+   {
+      auto itr = balances.find(owner.value);
+      if (itr == balances.end()) {
+         accounts acnts( self, owner.value );
+         auto ac = acnts.find( sym.raw() );
+
+         balancerow row;
+         row.exists = ac != acnts.end();
+         row.balance = row.exists ? ac->balance : asset(0, tknSymbol);
+         row.stakeTokens = row.exists ? stakedtokens(self, scope, owner, *ac) : 0;
+         itr = balances.emplace(owner.value, row).first;
+         rowsRead++;
+      }
+      return itr->second;
+   }
+
+   void token::tblcache::subbalance(const name& owner, const asset& value)
+   {
+      getbalance(owner);
+      auto& row = balances[owner.value];
+
+      check( row.exists, "no balance object found" );
+      check( row.balance.amount >= value.amount, "overdrawn balance" );
+
+      row.balance -= value;
+      dirtyBalances.insert(owner.value);
+   }
+
+   void token::tblcache::addbalance(const name& owner, const asset& value)
+   {
+      getbalance(owner);
+      auto& row = balances[owner.value];
+
+      row.balance += value;
+      dirtyBalances.insert(owner.value);
+   }
+
+   const token::pool& token::tblcache::getpool(const uint64_t id)
+   {
+      auto itr = poolRows.find(id);
+      if (itr == poolRows.end()) {
+         itr = poolRows.emplace(id, pools.get(id, "Pool not found.")).first;
+         rowsRead++;
+      }
+      return itr->second;
+   }
+
+   token::pool& token::tblcache::modpool(const uint64_t id)
+   {
+      getpool(id);
+      dirtyPools.insert(id);
+      return poolRows[id];
+   }
+
+   const token::poolholder& token::tblcache::getholder(const uint64_t id)
+   {
+      auto itr = holderRows.find(id);
+      if (itr == holderRows.end()) {
+         itr = holderRows.emplace(id, holders.get(id, "Holder not found.")).first;
+         rowsRead++;
+      }
+      return itr->second;
+   }
+
+   token::poolholder& token::tblcache::modholder(const uint64_t id)
+   {
+      getholder(id);
+      dirtyHolders.insert(id);
+      return holderRows[id];
+   }
+
+   asset token::tblcache::projected(const name& owner)
+   {
+      auto blnc = getbalance(owner).balance;
+
+      auto leg = legs.find(owner.value);
+      if (leg != legs.end()) {
+         blnc.amount += leg->second;
+      }
+      return blnc;
+   }
+
+   void token::tblcache::addleg(const name& from, const name& to, const asset& quantity)
+   {
+      legs[from.value] -= quantity.amount;
+      legs[to.value] += quantity.amount;
+   }
+
+   void token::tblcache::settle()
+   {
+      //-- one balance delta and one notification per account, legs that cancel out write nothing
+      for (auto& leg : legs)
+      {
+         if (leg.second < 0) {
+            subbalance(name(leg.first), asset(-leg.second, tknSymbol));
+         }
+         else if (leg.second > 0) {
+            check( trusted.count(leg.first) > 0 || is_account( name(leg.first) ), "to account does not exist");
+            addbalance(name(leg.first), asset(leg.second, tknSymbol));
+         }
+
+         require_recipient( name(leg.first) );
+      }
+
+      legs.clear();
+      trusted.clear();
+   }
+
+   void token::tblcache::addshardfee(const name& shard, const int64_t fees)
+   {
+      if (fees > 0) {
+         shardFees[shard.value] += fees;
+      }
+   }
+
+   void token::tblcache::flush(const name& payer)
+   {
+      //-- one write per modified row
+      for (auto id : dirtyPools) {
+         pools.modify(pools.get(id), payer, [&]( auto& row ) {
+            row = poolRows[id];
+         });
+      }
+      for (auto id : dirtyHolders) {
+         holders.modify(holders.get(id), payer, [&]( auto& row ) {
+            row = holderRows[id];
+         });
+      }
+
+      for (auto owner : dirtyBalances) {
+         accounts acnts( self, owner );
+         auto& row = balances[owner];
+
+         if (row.exists) {
+            acnts.modify(acnts.get(sym.raw()), payer, [&]( auto& a ) {
+               a.balance = row.balance;
+               a.stakeTokens = row.stakeTokens;
+            });
+         }
+         else {
+            acnts.emplace(payer, [&]( auto& a ) {
+               a.balance = row.balance;
+               a.stakeTokens = row.stakeTokens;
+            });
+            row.exists = true;
+         }
+      }
+
+      for (auto& fee : shardFees) {
+         auto itr = escrowFee.find(fee.first);
+
+         if (itr == escrowFee.end()) {
+            escrowFee.emplace(payer, [&]( auto& row ) {
+               row.shard = name(fee.first);
+               row.fees = fee.second;
+            });
+         }
+         else {
+            escrowFee.modify(itr, payer, [&]( auto& row ) {
+               row.fees += fee.second;
+            });
+         }
+      }
+
+      dirtyPools.clear();
+      dirtyHolders.clear();
+      dirtyBalances.clear();
+      shardFees.clear();
+   }
+
+   uint32_t token::tblcache::dirtyrows() const
+   {
+      return dirtyPools.size() + dirtyHolders.size() + dirtyBalances.size() + shardFees.size();
+   }
+
+
+   void token::reqservice(const int p_TID, const name p_hotel, const asset p_tokens)
+   {
+      chkmigratepools();
+      chkmigratev2();
+
+      //-- release expired locks before the cache reads pools, so no liquidity waits for the unlock timer
+      reclaimexpired(cfg().lazyUnlockRows);
+
+      tblcache cache(get_self(), get_first_receiver().value, m_symbol);
+
+      auto firstUnlockAt = bookservice(cache, service_req{ static_cast<uint64_t>(p_TID), p_hotel, p_tokens });
+
+      //-- schedule unlock service, only moves the in-flight unlock if this request's locks expire earlier
+      if (firstUnlockAt > 0) {
+         schdlunlock(firstUnlockAt);
+      }
+
+      MH_COUNT(rowsRead, cache.rowsRead);
+      MH_COUNT(rowsModified, cache.dirtyrows());
+      cache.flush(get_self());
+      sendevents();
+      MH_EMIT(name("reqservice"));
+   }
+
+   void token::reqservicebt(const std::vector<service_req> reqs)
+   {
+      check( !reqs.empty(), "No service requests." );
+      chkmigratepools();
+      chkmigratev2();
+
+      reclaimexpired(cfg().lazyUnlockRows);
+
+      tblcache cache(get_self(), get_first_receiver().value, m_symbol);
+      uint32_t firstUnlockAt = 0;
+
+      //-- pool and holder rows stay in the cache across the batch
+      for (auto& req : reqs)
+      {
+         auto unlockAt = bookservice(cache, req);
+
+         if (unlockAt > 0 && (firstUnlockAt == 0 || unlockAt < firstUnlockAt)) {
+            firstUnlockAt = unlockAt;
+         }
+      }
+
+      if (firstUnlockAt > 0) {
+         schdlunlock(firstUnlockAt);
+      }
+
+      MH_COUNT(rowsRead, cache.rowsRead);
+      MH_COUNT(rowsModified, cache.dirtyrows());
+      cache.flush(get_self());
+      sendevents();
+      MH_EMIT(name("reqservicebt"));
+   }
+
+
+   //-- (private) pool checks reqservice and quote apply before borrowing from a pool
+   bool token::canlend(tblcache& cache, const pool& curPool, const name& hotel)
+   {
+      //-- if no amount
+      const auto& ac = cache.getbalance(curPool.poolName);
+
+      if( !ac.exists ) {
+         return false;
+      }
+
+      //-- if pool amount is zero goto next pool
+      if(ac.balance.amount <= 0) {
+         return false;
+      }
+
+      //-- if current pool collateral account blnc is less than pool's collateral amount (on reg time) then goto next pool 
+      const auto& currPoolCA = cache.getbalance(curPool.colaterlAcnt).balance;
+
+      if(currPoolCA.amount < curPool.colaterlAmnt.amount) {
+         return false;
+      }
+
+      //-- if pool lock time is not passed goto next pool
+      // if(curPool.lockTime > now()) {
+      //    return false;
+      // }
+
+      //-- check if hotel is in restricted list of pool, last as it reads a table outside the cache
+      return !isrestricted(curPool, hotel);
+   }
+
+   //-- (private)
+   bool token::isrestricted(const pool& curPool, const name& hotel)
+   {
+      for(auto& restrictedItem : curPool.arRestriction) {
+         if(restrictedItem == hotel) {
+            return true;
+         }
+      }
+
+      restrictions tblRestrictions(get_self(), curPool.poolName.value);
+      return tblRestrictions.find(hotel.value) != tblRestrictions.end();
+   }
+
+   token::quote_result token::quote(const name p_hotel, const asset p_tokens)
+   {
+      check( p_tokens.symbol == m_tknSymbol, "symbol precision mismatch" );
+      check( p_tokens.amount > 0, "must quote positive quantity" );
+
+      //-- rows are only read, the cache is never flushed
+      tblcache cache(get_self(), get_first_receiver().value, m_symbol);
+      quote_result result { {}, m_zeroTokens, tknasset(bpsamount(p_tokens.amount, cfg().modihostFees)), m_zeroTokens };
+      int64_t tokensRemaining = p_tokens.amount;
+      const uint32_t lazyRows = cfg().lazyUnlockRows;
+
+      //-- reqservice first releases the oldest expired pool locks, project what it would release
+      std::map<uint64_t, int64_t> released;
+      std::set<uint64_t> counted;
+      auto expiryIndex = cache.poolTknLock.get_index<name("lockeduntil")>();
+      uint32_t rows = 0;
+
+      for (auto lock = expiryIndex.begin(); lock != expiryIndex.end() && lock->lockedUntil <= now() && rows < lazyRows; lock++, rows++)
+      {
+         released[lock->poolID] += lock->tokens;
+         counted.insert(lock->ID);
+      }
+
+      //-- pools these locks make borrowable, not in the borrowable part of the eligible index yet
+      std::vector<uint64_t> freed;
+
+      for (const auto& rel : released)
+      {
+         const auto& curPool = cache.getpool(rel.first);
+
+         if (curPool.ID != 0 && curPool.isActive && !curPool.isborrowable()) {
+            freed.push_back(curPool.ID);
+         }
+      }
+
+      std::sort(freed.begin(), freed.end(), [&]( const uint64_t a, const uint64_t b ) {
+         return std::make_pair(cache.getpool(a).reward, a) < std::make_pair(cache.getpool(b).reward, b);
+      });
+
+      //-- borrowable pools in eligible order, lowest reward fees first, merged with the freed ones
+      auto eligIndex = cache.pools.get_index<name("eligible")>();
+      auto item = eligIndex.begin();
+      auto itrFreed = freed.begin();
 
-      while(itr != tblPoolTknLocks.end())
+      while (tokensRemaining > 0)
       {
-         if(itr->lockedUntil <= now()) //-- tokens lock time has passed
-         { 
-            auto poolItr = pools.find(itr->poolID);
-      
-            //-- add in available tokens
-            pools.modify(poolItr, get_self(), [&]( auto& row ) {
-               row.avlblTokens.amount = row.avlblTokens.amount + itr->tokens.amount;
-            });
-            
-            //-- dlt lock entry
-            itr = tblPoolTknLocks.erase(itr);
+         bool fromIndex = item != eligIndex.end() && item->isborrowable();
+         uint64_t poolID;
+
+         if (itrFreed != freed.end() &&
+             (!fromIndex || std::make_pair(cache.getpool(*itrFreed).reward, *itrFreed) < std::make_pair(item->reward, item->ID))) {
+            poolID = *itrFreed;
+            itrFreed++;
+         }
+         else if (fromIndex) {
+            poolID = item->ID;
+            item++;
          }
          else {
-            itr++;
+            break;
          }
-      }
 
+         const auto& curPool = cache.getpool(poolID);
+         auto itrReleased = released.find(poolID);
+         int64_t avlblTokens = curPool.avlblTokens.amount + (itrReleased == released.end() ? 0 : itrReleased->second);
 
-      //-- UNLOCK HOLDER TOKENS
-      auto itr2 = tblHldrTknLock.begin();
+         //-- then bookservice releases this pool's own expired locks, the ones released above are gone by then
+         auto lockIndex = cache.poolTknLock.get_index<name("poolexpiry")>();
+         auto lock = lockIndex.lower_bound(lockexpirykey(poolID, 0));
+         uint32_t poolRows = 0;
 
-      while(itr2 != tblHldrTknLock.end())
-      {
-         if(itr2->lockedUntil <= now()) //-- tokens lock time has passed
-         { 
-            auto holderItr = holders.find(itr2->holderID);
-            print(" unlocked ", itr2->poolName, itr2->holder, itr2->tokens.amount, " -- ");
-      
-            //-- add in available tokens
-            holders.modify(holderItr, get_self(), [&]( auto& row ) {
-               row.remainingTokens.amount = row.remainingTokens.amount + itr2->tokens.amount;
-            });
-            
-            //-- dlt lock entry
-            itr2 = tblHldrTknLock.erase(itr2);
+         for (; lock != lockIndex.end() && lock->pkpoolexpiry() <= lockexpirykey(poolID, now()) && poolRows < lazyRows; lock++)
+         {
+            if (counted.count(lock->ID) == 0) {
+               avlblTokens += lock->tokens;
+               poolRows++;
+            }
          }
-         else {
-            itr2++;
+
+         if(!canlend(cache, curPool, p_hotel)) {
+            continue;
          }
+
+         auto poolTokensUsed = std::min(tokensRemaining, avlblTokens);
+         result.fills.push_back({ curPool.poolName, curPool.reward, tknasset(poolTokensUsed), tknasset(bpsamount(poolTokensUsed, curPool.reward)) });
+         tokensRemaining -= poolTokensUsed;
       }
-   }
 
+      //-- rest comes from the main pool
+      if (tokensRemaining > 0) {
+         const auto& mainPool = cache.getpool(0);
+         result.fills.push_back({ mainPool.poolName, mainPool.reward, tknasset(tokensRemaining), tknasset(bpsamount(tokensRemaining, mainPool.reward)) });
+      }
 
-   void token::reqservice(const int p_TID, const name p_hotel, const asset p_tokens)
+      for (const auto& fill : result.fills) {
+         result.totalTokens += fill.tokens;
+         result.rewardTokens += fill.rewardTokens;
+      }
+
+      return result;
+   }
+
+   token::holder_page token::poolhldrs(const name pool, const uint64_t cursor, const uint32_t limit)
    {
-      hotelFeeReqs tblHotelFeeReqs (get_self(), get_first_receiver().value);
+      check( limit > 0, "limit must be positive." );
+
       poolstable pools(get_self(), get_first_receiver().value);
-      poolTokenReqs tblPoolTokenReqs (get_self(), get_first_receiver().value);
-      pooltknlocks tblPoolTknLocks (get_self(), get_first_receiver().value);
-      
-      //-- check if TID already exists
-      auto itrHtl = tblHotelFeeReqs.find(p_TID);
-      check(itrHtl == tblHotelFeeReqs.end(), "TID already exists.");
+      poolholders holders(get_self(), get_first_receiver().value);
 
+      auto poolIndex = pools.get_index<name("poolname")>();
+      auto itrPool = poolIndex.find(pool.value);
+      check(itrPool != poolIndex.end(), "Pool does not exist.");
 
-      double feeTokensDouble = (modihostFees/100) * (p_tokens.amount/10000);
-      uint64_t feeTokensAmount = feeTokensDouble * 10000;
+      holder_page page { {}, cursor, true };
 
-      asset tokensFound (0, symbol(m_symbol,4));
-      asset feeTokens (feeTokensAmount, symbol(m_symbol,4));
-      asset tokensRemaining (p_tokens.amount, symbol(m_symbol,4));
-      asset poolTokensUsed (0, symbol(m_symbol,4));
-      asset poolRewardTokens (0, symbol(m_symbol,4));
-      uint64_t totalRewardTokens = 0;
-      bool restrictCheck = false;
+      //-- the "poolid" range of this pool, rows of other pools are never visited
+      auto hldrIndex = holders.get_index<name("poolid")>();
+      auto hldrItr = hldrIndex.lower_bound(hldrpoolidkey(pool, cursor));
 
-      //-- UNLOCK LOCKED TOKENS FROM POOLS
-      // unlkpooltkns();
+      for (; hldrItr != hldrIndex.end() && hldrItr->poolName == pool; hldrItr++)
+      {
+         if (page.holders.size() >= limit) {
+            page.next = hldrItr->ID;
+            page.done = false;
+            break;
+         }
 
+         page.holders.push_back({ hldrItr->ID, hldrItr->holder, tknasset(hldrItr->tokens), tknasset(hldrItr->remainingTokens),
+                                  tknasset(hldrreward(*itrPool, *hldrItr)), hldrItr->isActive });
+      }
 
-      //-- CHECK TOKENS FROM POOLS
-      auto tidIndex = pools.get_index<name("reward")>(); //order by lowest reward fees
+      return page;
+   }
 
-      // for(auto& item : pools) {
-      for (auto item = tidIndex.begin(); item != tidIndex.end(); item++)
-      {
-         //-- if no amount
-         accounts accountstable ( get_self(), item->poolName.value );
-         const auto& ac = accountstable.find( m_symbol.raw() );
+   uint32_t token::bookservice(tblcache& cache, const service_req& req)
+   {
+      const uint64_t p_TID = req.TID;
+      const name p_hotel = req.hotel;
+      const asset p_tokens = req.tokens;
 
-         if( ac == accountstable.end() ) {
-            continue;
-         }
+      //-- check if TID already exists
+      auto itrHtl = cache.hotelFeeReq.find(p_TID);
+      check(itrHtl == cache.hotelFeeReq.end(), "TID already exists.");
 
-         auto pool = token::get_balance(get_self(), name(item->poolName), symbol_code(m_symbol));
-         auto currPoolCA = token::get_balance(get_self(), name(item->colaterlAcnt), symbol_code(m_symbol));
 
+      int64_t feeTokensAmount = bpsamount(p_tokens.amount, cfg().modihostFees);
 
-         //-- if pool is mainpool goto next pool
-         if(item->ID == 0) {
-            continue;
-         }
-         
-         //-- if pool is active
-         if(!item->isActive) {
-            continue;
-         }
-         
-         //-- if current pool collateral account blnc is less than pool's collateral amount (on reg time) then goto next pool 
-         if(currPoolCA.amount < item->colaterlAmnt.amount) {
-            continue;
-         }
+      asset tokensFound = m_zeroTokens;
+      asset feeTokens = tknasset(feeTokensAmount);
+      asset tokensRemaining = tknasset(p_tokens.amount);
 
-         //-- if pool lock time is not passed goto next pool
-         // if(item->lockTime > now()) {
-         //    continue;
-         // }
+      //-- initialize and setconfig checked the shard accounts, settle skips is_account for this one
+      cache.trusted.insert( escrowshard(p_TID).value );
+      asset poolTokensUsed = m_zeroTokens;
+      asset poolRewardTokens = m_zeroTokens;
+      int64_t totalRewardTokens = 0;
+      uint32_t firstUnlockAt = 0;
 
-         //-- if pool tokens locked goto next pool
-         if(item->avlblTokens.amount <= 0) {
-            print(" no or locked amount ", item->poolName, " -- ");
-            continue;
-         }
+      //-- the calling action released the oldest expired locks, each pool and holder borrowed from releases its own below
+
+
+      //-- CHECK TOKENS FROM POOLS
+      //-- active pools with available tokens come first in this index, lowest reward fees first
+      //-- the index holds table state, cached rows hold what earlier requests of this action already took
+      auto eligIndex = cache.pools.get_index<name("eligible")>();
+
+      for (auto item = eligIndex.begin(); item != eligIndex.end() && item->isborrowable(); item++)
+      {
+         reclaimpool(cache, item->ID, cfg().lazyUnlockRows);
+
+         const auto& curPool = cache.getpool(item->ID);
+         MH_COUNT(poolsScanned, 1);
 
-         //-- if pool amount is zero goto next pool
-         if(pool.amount <= 0) {
+         if(!curPool.isborrowable()) {
             continue;
          }
 
-         //-- check if hotel is in restricted list of pool
-         for(auto& restrictedItem : item->arRestriction) {
-            if(restrictedItem == p_hotel) {
-               restrictCheck = true;
-               continue;
-            }
-         }
-         if(restrictCheck) {
-            restrictCheck = false;
+         if(!canlend(cache, curPool, p_hotel)) {
             continue;
          }
-          
 
          //-- if this pool has all tokens needed
-         if (tokensRemaining.amount <= item->avlblTokens.amount) {
+         if (tokensRemaining.amount <= curPool.avlblTokens.amount) {
             poolTokensUsed.amount = tokensRemaining.amount;
          }
          //-- else if this pool doesnt have all tokens needed
          else {
-            poolTokensUsed.amount = item->avlblTokens.amount;
+            poolTokensUsed.amount = curPool.avlblTokens.amount;
          }
 
          tokensFound.amount += poolTokensUsed.amount;
          
-         auto plBlnc = token::get_balance(get_self(), name(item->poolName), symbol_code(m_symbol));
-         check( plBlnc.amount >= poolTokensUsed.amount, "Insufficient pool token balance." );
+         check( cache.projected(curPool.poolName).amount >= poolTokensUsed.amount, "Insufficient pool token balance." );
       
-         token::transfer2Esc(name(item->poolName), name(m_escrow), poolTokensUsed, "-");
+         internalleg(cache, name(curPool.poolName), escrowshard(p_TID), poolTokensUsed.amount);
          
          //-- calculate reward tokens on pool's total tokens used
-         double rewardTokensDouble = (item->reward/100) * (poolTokensUsed.amount/10000);
-         uint64_t rewardTokensAmount = rewardTokensDouble * 10000;
-         asset rewardTokens (rewardTokensAmount, symbol(m_symbol,4));
+         asset rewardTokens = tknasset(bpsamount(poolTokensUsed.amount, curPool.reward));
          
-         //-- calculate pool's poolholders % on reward tokens
-         double poolPercDouble = (item->ownerShare/100) * (rewardTokensDouble);
-         poolRewardTokens.amount = poolPercDouble * 10000;
+         //-- calculate pool owner's % on reward tokens
+         poolRewardTokens.amount = bpsamount(rewardTokens.amount, curPool.ownerShare);
 
          totalRewardTokens += rewardTokens.amount;
 
          //-- save pool and tokens
-         tblPoolTokenReqs.emplace(get_self(), [&]( auto& row ) {
-            row.ID = tblPoolTokenReqs.available_primary_key();
+         cache.poolTokenReq.emplace(get_self(), [&]( auto& row ) {
+            row.ID = cache.poolTokenReq.available_primary_key();
             row.TID = p_TID;
             row.hotel = p_hotel;
-            row.poolID = item->ID;
-            row.pool = name(item->poolName);
+            row.poolID = curPool.ID;
+            row.pool = name(curPool.poolName);
             row.totalTokens = poolTokensUsed;
-            row.rewardPerc = item->reward;
+            row.rewardPerc = curPool.reward;
             row.rewardTokens = rewardTokens;
             row.createdDate = now();
             row.ownerRewardTokens = poolRewardTokens;
          });
+         MH_COUNT(rowsEmplaced, 1);
+         logev(m_evBooking, p_TID, curPool.poolName, p_hotel, poolTokensUsed.amount, rewardTokens.amount, 0);
 
-         uint32_t lockedUntil = now() + item->lockInSecs;
+         uint32_t lockedUntil = now() + curPool.lockInSecs;
          
-         //-- get toke8ns from token holders
-         updhldrtkns(p_TID, poolTokensUsed, p_hotel, item->poolName, item->reward, item->holderShare, lockedUntil);
+         //-- get tokens from token holders, pro-rata pools only keep the pool level lock
+         if (curPool.holderPolicy != m_plcyProRata) {
+            updhldrtkns(cache, poolTokensUsed, curPool.poolName, curPool.holderPolicy, lockedUntil);
+         }
 
 
          //-- update pool lock time & avlbl tokens
-         auto poolItr = pools.find(item->ID);
-   
-         pools.modify(poolItr, get_self(), [&]( auto& row ) {
-            row.lockTime = now() + item->lockInSecs;
-            row.avlblTokens = row.avlblTokens - poolTokensUsed;
-         });
-
-         tblPoolTknLocks.emplace(get_self(), [&]( auto& row ) {
-            row.ID = tblPoolTknLocks.available_primary_key();
-            row.poolID = item->ID;
-            row.poolName = name(item->poolName);
-            row.tokens = poolTokensUsed;
+         auto& poolRow = cache.modpool(curPool.ID);
+         poolRow.lockTime = lockedUntil;
+         poolRow.avlblTokens = poolRow.avlblTokens - poolTokensUsed;
+
+         cache.poolTknLock.emplace(get_self(), [&]( auto& row ) {
+            row.ID = cache.poolTknLock.available_primary_key();
+            row.poolID = curPool.ID;
+            row.tokens = poolTokensUsed.amount;
             row.lockedUntil = lockedUntil;
             row.createdDate = now();
          });
+         MH_COUNT(rowsEmplaced, 1);
          
 
          tokensRemaining.amount = p_tokens.amount - tokensFound.amount;
          
-         //-- schedule unlock service
-         print(now() + item->ID + p_hotel.value + p_TID);
-         calldeferred(item->lockInSecs, now() + item->ID + p_hotel.value + p_TID); // add pool id in current time to make it unique
+         //-- earliest lock of this request
+         if (firstUnlockAt == 0 || lockedUntil < firstUnlockAt) {
+            firstUnlockAt = lockedUntil;
+         }
 
          //-- check if all tokens are found then break loop         
          if (tokensFound.amount >= p_tokens.amount) {
@@ -1056,73 +2233,82 @@ namespace eosio {
 
       //-- check if tokens not found then goto mainpool
       if (tokensFound.amount < p_tokens.amount) {
-         auto ownrItr = pools.find(0);
+         const auto& mainPool = cache.getpool(0);
 
          poolTokensUsed.amount = tokensRemaining.amount;
          
          tokensFound.amount += poolTokensUsed.amount;
-         token::transfer2Esc(m_mainpool, name(m_escrow), poolTokensUsed, "-");
+
+         //-- the main pool's legs of this TID net out, so settle never sees it overdrawn, check it here
+         const auto& mainBlnc = cache.getbalance(m_mainpool);
+         check( mainBlnc.exists && cache.projected(m_mainpool).amount - mainBlnc.stakeTokens >= poolTokensUsed.amount, "Insufficient main pool token balance." );
+
+         internalleg(cache, m_mainpool, escrowshard(p_TID), poolTokensUsed.amount);
          
          //-- calculate reward tokens on pool's total tokens used
-         double rewardTokensDouble = (ownrItr->reward/100) * (poolTokensUsed.amount/10000);
-         uint64_t rewardTokensAmount = rewardTokensDouble * 10000;
-         asset rewardTokens (rewardTokensAmount, symbol(m_symbol,4));
+         asset rewardTokens = tknasset(bpsamount(poolTokensUsed.amount, mainPool.reward));
          
-         //-- calculate pool's poolholders % on reward tokens
-         double poolPercDouble = (ownrItr->ownerShare/100) * (rewardTokensDouble);
-         poolRewardTokens.amount = poolPercDouble * 10000;
+         //-- calculate pool owner's % on reward tokens
+         poolRewardTokens.amount = bpsamount(rewardTokens.amount, mainPool.ownerShare);
 
          totalRewardTokens += rewardTokens.amount;
 
          //-- save pool and tokens
-         tblPoolTokenReqs.emplace(get_self(), [&]( auto& row ) {
-            row.ID = tblPoolTokenReqs.available_primary_key();
+         cache.poolTokenReq.emplace(get_self(), [&]( auto& row ) {
+            row.ID = cache.poolTokenReq.available_primary_key();
             row.TID = p_TID;
             row.hotel = p_hotel;
-            row.poolID = ownrItr->ID;
-            row.pool = name(ownrItr->poolName);
+            row.poolID = mainPool.ID;
+            row.pool = name(mainPool.poolName);
             row.totalTokens = poolTokensUsed;
             row.rewardTokens = rewardTokens;
-            row.rewardPerc = ownrItr->reward;
+            row.rewardPerc = mainPool.reward;
             row.createdDate = now();
             row.ownerRewardTokens = poolRewardTokens;
          });
+         MH_COUNT(rowsEmplaced, 1);
+         logev(m_evBooking, p_TID, mainPool.poolName, p_hotel, poolTokensUsed.amount, rewardTokens.amount, 0);
          
          tokensRemaining.amount = p_tokens.amount - tokensFound.amount;
       }
 
 
-      //-- SAVE HOTEL REQUISITION      
-      tblHotelFeeReqs.emplace(get_self(), [&]( auto& row ) {
-         row.TID = p_TID;
-         row.hotel = p_hotel;
-         row.isFeePaid = 0;
-         row.isServiceProvided = 0;
-         row.totalTokens = tokensFound;
-         row.feesTokens = feeTokens;
-         row.createdDate = now();
-         row.rewardTokens = asset(totalRewardTokens, symbol(m_symbol,4));
-      });
+      //-- HOTEL REQUISITION, booked and settled in this action so it is written once in its final state
+      hotelFeeReq feeReq;
+      feeReq.TID = p_TID;
+      feeReq.hotel = p_hotel;
+      feeReq.isFeePaid = 1;
+      feeReq.isServiceProvided = 1;
+      feeReq.totalTokens = tokensFound;
+      feeReq.feesTokens = feeTokens;
+      feeReq.createdDate = now();
+      feeReq.rewardTokens = tknasset(totalRewardTokens);
 
 
       //-- SEND FEES TO ESCROW FROM HOTEL
-      sndfee2escrw(p_TID, p_hotel);
+      payhotelfee(cache, feeReq, p_hotel);
       
       //-- SERVICE PROVIDED TO HOTEL FROM MODIHOST
-      servprvd2htl(p_TID);
+      settleservice(cache, feeReq);
+
+      //-- SAVE HOTEL REQUISITION
+      cache.hotelFeeReq.emplace(get_self(), [&]( auto& row ) {
+         row = feeReq;
+      });
+      MH_COUNT(rowsEmplaced, 1);
+
+      //-- one balance update and one notification per account for all legs of this TID
+      cache.settle();
+
+      return firstUnlockAt;
    }
 
 
    //-- (private)
-   void token::updhldrtkns(const int p_TID, const asset p_tokensRemaining, const name p_hotel, const name p_pool, const double p_reward, const double p_holderPerc, const uint32_t lockedUntil)
+   void token::updhldrtkns(tblcache& cache, const asset p_tokensRemaining, const name p_pool, const uint8_t policy, const uint32_t lockedUntil)
    {
-      poolholders holders (get_self(), get_first_receiver().value);
-      holderTknReqs holdrTknReqs (get_self(), get_first_receiver().value);
-      hldrtknlocks tblHldrTknLock (get_self(), get_first_receiver().value);
-
-      asset hldrTokensFound (0, symbol(m_symbol,4)); // 0 initially, will increase with each loop 
-      asset hldrRewardTokens (0, symbol(m_symbol,4));
-      asset hldrTokensUsed (0, symbol(m_symbol,4));
+      asset hldrTokensFound = m_zeroTokens; // 0 initially, will increase with each loop 
+      asset hldrTokensUsed = m_zeroTokens;
       
       struct holderdata {
          uint64_t hid;
@@ -1131,74 +2317,71 @@ namespace eosio {
       std::vector<holderdata> v;
       holderdata str;
 
-      // auto hldrIndex = holders.get_index<name("poolname")>();
-      // auto itr = hldrIndex.find(p_pool.value);
+      //-- borrow from one holder, true once all tokens are found
+      auto takeholder = [&]( const uint64_t holderID ) {
+         MH_PRINT(" -h ", holderID);
+         MH_COUNT(holdersScanned, 1);
 
-      auto hldrIndex = holders.get_index<name("lastusedat")>();
+         reclaimholder(cache, holderID, cfg().lazyUnlockRows);
+         const auto& holder = cache.getholder(holderID);
 
-      //-- loop over holders of this pool
-      for (auto itr = hldrIndex.begin(); itr != hldrIndex.end(); itr++)
-      {
-         //-- loop if this pool 
-         if(itr->poolName == p_pool) 
-         {
-            print(" -h ", itr->ID);
+         //-- check if holder is active
+         if(holder.isActive == false) {
+            return false;
+         }
 
-            //-- check if holder is active
-            if(itr->isActive == false) {
-               continue;
-            }
+         //-- if holder amount is zero goto next holder
+         if(holder.remainingTokens <= 0) {
+            return false;
+         }
 
-            //-- if holder amount is zero goto next holder
-            if(itr->remainingTokens.amount <= 0) {
-               continue;
-            }
+         if ((p_tokensRemaining.amount - hldrTokensFound.amount) <= holder.remainingTokens) {
+            hldrTokensUsed.amount = (p_tokensRemaining.amount - hldrTokensFound.amount);
+         }
+         else {
+            hldrTokensUsed.amount = holder.remainingTokens;
+         }
+         
+         hldrTokensFound.amount += hldrTokensUsed.amount;
+
+         //-- holder's reward is not tracked per borrow, it accrues on the pool's reward per token
+         str = { holder.ID, hldrTokensUsed.amount};
+         v.push_back(str); 
+       
+         cache.hldrTknLock.emplace(get_self(), [&]( auto& row ) {
+            row.ID = cache.hldrTknLock.available_primary_key();
+            row.holderID = holder.ID;
+            row.tokens = hldrTokensUsed.amount;
+            row.lockedUntil = lockedUntil;
+            row.createdDate = now();
+         });
+         MH_COUNT(rowsEmplaced, 1);
 
-            if ((p_tokensRemaining.amount - hldrTokensFound.amount) <= itr->remainingTokens.amount) {
-               hldrTokensUsed.amount = (p_tokensRemaining.amount - hldrTokensFound.amount);
-            }
-            else {
-               hldrTokensUsed.amount = itr->remainingTokens.amount;
-            }
-            
-            hldrTokensFound.amount += hldrTokensUsed.amount;
+         return hldrTokensFound.amount >= p_tokensRemaining.amount;
+      };
 
-            //-- calculate reward tokens on holder's total tokens used
-            double rewardTokensDouble = (p_reward/100) * (hldrTokensUsed.amount/10000);
-            
-            //-- calculate holder's % on reward tokens
-            double holderPercDouble = (p_holderPerc/100) * (rewardTokensDouble);
-            hldrRewardTokens.amount = holderPercDouble * 10000;
-
-            //-- insert in holder token transactions
-            holdrTknReqs.emplace(get_self(), [&]( auto& row ) {
-               row.ID = holdrTknReqs.available_primary_key();
-               row.TID = p_TID;
-               row.hotel = p_hotel;
-               row.pool = p_pool;
-               row.holderID = itr->ID;
-               row.holder = itr->holder;
-               row.tokens = hldrTokensUsed;
-               row.createdDate = now();
-               row.rewardTokens = hldrRewardTokens;
-            });
+      if (policy == m_plcyLargest) {
+         //-- holders of this pool from the most remaining tokens down
+         auto hldrIndex = cache.holders.get_index<name("poolremain")>();
+         auto itr = hldrIndex.upper_bound(hldrpoolremkey(p_pool, std::numeric_limits<int64_t>::max()));
 
+         while (itr != hldrIndex.begin())
+         {
+            itr--;
 
-            str = { itr->ID, hldrTokensUsed.amount};
-            v.push_back(str); 
-          
-            tblHldrTknLock.emplace(get_self(), [&]( auto& row ) {
-               row.ID = tblHldrTknLock.available_primary_key();
-               row.poolName = name(itr->poolName);
-               row.holderID = itr->ID;
-               row.holder = name(itr->holder);
-               row.tokens = hldrTokensUsed;
-               row.lockedUntil = lockedUntil;
-               row.createdDate = now();
-            });
+            if (itr->poolName != p_pool || takeholder(itr->ID)) {
+               break;
+            }
+         }
+      }
+      else {
+         //-- holders of this pool ordered by last used time
+         auto hldrIndex = cache.holders.get_index<name("poollastused")>();
+         auto itr = hldrIndex.lower_bound(uint128_t{p_pool.value} << 64);
 
-            //-- check if all tokens are found then break loop         
-            if (hldrTokensFound.amount >= p_tokensRemaining.amount) {
+         for (; itr != hldrIndex.end() && itr->poolName == p_pool; itr++)
+         {
+            if (takeholder(itr->ID)) {
                break;
             }
          }
@@ -1207,19 +2390,13 @@ namespace eosio {
       //-- update holder's remaining tokens
       for(auto i : v) 
       {
-         auto hldrItr = holders.find(i.hid);
+         auto& holder = cache.modholder(i.hid);
 
-         if ( (hldrItr->remainingTokens.amount - i.hldrTokensUsed) > 0) //-- if all tokens are not borrowed, dnt update time
-         {
-            holders.modify(hldrItr, get_self(), [&]( auto& row ) {
-               row.remainingTokens.amount = row.remainingTokens.amount - i.hldrTokensUsed;
-            });
-         }
-         else {
-            holders.modify(hldrItr, get_self(), [&]( auto& row ) {
-               row.remainingTokens.amount = row.remainingTokens.amount - i.hldrTokensUsed;
-               row.lastUsedAt = now();
-            });
+         holder.remainingTokens -= i.hldrTokensUsed;
+         
+         //-- if all tokens are not borrowed, dnt update time
+         if (holder.remainingTokens <= 0) {
+            holder.lastUsedAt = now();
          }
       }
    }
@@ -1227,150 +2404,208 @@ namespace eosio {
 
    void token::sndfee2escrw(const int p_TID, const name from)
    {
+      tblcache cache(get_self(), get_first_receiver().value, m_symbol);
+
       //-- get TID record
-      hotelFeeReqs tblHotelFeeReqs( get_self(), get_first_receiver().value);
-      auto iterator = tblHotelFeeReqs.find(p_TID);
-      check(iterator != tblHotelFeeReqs.end(), "Record does not exist for TID.");
-      
-      uint64_t feeAndReward = (*iterator).feesTokens.amount + (*iterator).rewardTokens.amount;
-      
-      //-- check hotel has required tokens
-      auto hotelBlnc = token::get_balance(get_self(), from, symbol_code(m_symbol));
-      check( hotelBlnc.amount >= feeAndReward, "Insufficient token balance." );
-      
-      //-- transfer fees tokens to escrow
-      token::transfer(from, name(m_escrow), asset(feeAndReward, symbol(m_symbol,4)), "fees to escrow");
+      auto iterator = cache.hotelFeeReq.find(p_TID);
+      check(iterator != cache.hotelFeeReq.end(), "Record does not exist for TID.");
+
+      payhotelfee(cache, *iterator, from);
 
       //-- update hotel fees paid flag
-      tblHotelFeeReqs.modify(iterator, get_self(), [&]( auto& row ) {
+      cache.hotelFeeReq.modify(iterator, get_self(), [&]( auto& row ) {
         row.isFeePaid = 1;
       });
+      MH_COUNT(rowsModified, 1);
+
+      cache.settle();
+      MH_COUNT(rowsRead, cache.rowsRead);
+      MH_COUNT(rowsModified, cache.dirtyrows());
+      cache.flush(get_self());
+      MH_EMIT(name("sndfee2escrw"));
+   }
+
+   //-- (private)
+   //-- fee legs of a booking, the caller writes the isFeePaid flag
+   void token::payhotelfee(tblcache& cache, const hotelFeeReq& req, const name from)
+   {
+      int64_t feeAndReward = req.feesTokens.amount + req.rewardTokens.amount;
+      const name escrow = escrowshard(req.TID);
+      
+      //-- check hotel has required tokens
+      auto hotelBlnc = cache.projected(from);
+      check( hotelBlnc.amount >= feeAndReward, "Insufficient token balance." );
       
-      auto escBlnc = token::get_balance(get_self(), m_escrow, symbol_code(m_symbol));
-      check( escBlnc.amount >= (*iterator).totalTokens.amount, "Insufficient escrow token balance." );
+      //-- transfer fees tokens to escrow, hotel signs this like a transfer action
+      require_auth( from );
+      token::transfer2Esc(cache, from, escrow, tknasset(feeAndReward), "fees to escrow");
+
+      //-- check tokens locked in pool collateral
+      auto stakeTokens = cache.getbalance(from).stakeTokens;
+      if (stakeTokens > 0)
+      {
+         check(cache.projected(from).amount >= stakeTokens, "overdrawn balance, locked in pool collateral");
+      }
+
+      auto escBlnc = cache.projected(escrow);
+      check( escBlnc.amount >= req.totalTokens.amount, "Insufficient escrow token balance." );
       
       //-- transfer tokens from escrow to modihost
-      token::transfer2Esc(name(m_escrow), name(m_modihost), (*iterator).totalTokens, "tokens from escrow to modihost");
+      internalleg(cache, escrow, name(m_modihost), req.totalTokens.amount);
    }
 
 
    void token::servprvd2htl(const int p_TID)
    {
+      tblcache cache(get_self(), get_first_receiver().value, m_symbol);
+
       //-- get TID record
-      hotelFeeReqs tblHotelFeeReqs( get_self(), get_first_receiver().value);
-      auto iterator = tblHotelFeeReqs.find(p_TID);
-      check(iterator != tblHotelFeeReqs.end(), "Record does not exist for TID.");
+      auto iterator = cache.hotelFeeReq.find(p_TID);
+      check(iterator != cache.hotelFeeReq.end(), "Record does not exist for TID.");
 
-      //-- check modihost has required tokens
-      auto modiBlnc = token::get_balance(get_self(), get_self(), symbol_code(m_symbol));
-      check( modiBlnc.amount >= (*iterator).totalTokens.amount, "Insufficient token balance." );
-      
-      //-- transfer total tokens to escrow
-      token::transfer2Esc(name(m_modihost), name(m_escrow), (*iterator).totalTokens, "Transfer from modihost to escrow.");
+      settleservice(cache, *iterator);
 
       //-- update service done flag
-      tblHotelFeeReqs.modify(iterator, get_self(), [&]( auto& row ) {
+      cache.hotelFeeReq.modify(iterator, get_self(), [&]( auto& row ) {
         row.isServiceProvided = 1;
       });
+      MH_COUNT(rowsModified, 1);
+
+      cache.settle();
+      MH_COUNT(rowsRead, cache.rowsRead);
+      MH_COUNT(rowsModified, cache.dirtyrows());
+      cache.flush(get_self());
+      sendevents();
+      MH_EMIT(name("servprvd2htl"));
+   }
+
+   void token::sweepescrow()
+   {
+      require_auth( m_modihost );
+
+      escrowfees tblEscrowFee(get_self(), get_first_receiver().value);
+
+      //-- one transfer per shard holding fees, bookings in flight keep the rest of the shard balance
+      for (auto itr = tblEscrowFee.begin(); itr != tblEscrowFee.end(); itr++)
+      {
+         if (itr->fees <= 0) {
+            continue;
+         }
+
+         token::transfer2Esc(itr->shard, name(m_modihost), tknasset(itr->fees), "Sweep booking fees from escrow shard.");
+
+         tblEscrowFee.modify(itr, get_self(), [&]( auto& row ) {
+            row.fees = 0;
+         });
+      }
+   }
+
+   //-- (private)
+   //-- settlement legs of a booking, the caller writes the isServiceProvided flag
+   void token::settleservice(tblcache& cache, const hotelFeeReq& req)
+   {
+      const uint64_t p_TID = req.TID;
+      const name escrow = escrowshard(p_TID);
+
+      //-- check modihost has required tokens
+      auto modiBlnc = cache.projected(get_self());
+      check( modiBlnc.amount >= req.totalTokens.amount, "Insufficient token balance." );
+      
+      //-- transfer total tokens to escrow
+      internalleg(cache, name(m_modihost), escrow, req.totalTokens.amount);
 
 
-      auto escBlnc = token::get_balance(get_self(), m_escrow, symbol_code(m_symbol));
-      check( escBlnc.amount >= (*iterator).feesTokens.amount, "Insufficient escrow token balance." );
+      auto escBlnc = cache.projected(escrow);
+      check( escBlnc.amount >= req.feesTokens.amount, "Insufficient escrow token balance." );
       
-      //-- send fees to modihost
-      token::transfer2Esc(name(m_escrow), name(m_modihost), (*iterator).feesTokens, "Transfer fees from escrow to modihost.");
+      //-- fees stay on the shard, sweepescrow sends them to modihost
+      cache.addshardfee(escrow, req.feesTokens.amount);
 
 
-      //-- get pools for this TID
-      poolTokenReqs tblPoolTokenReqs (get_self(), get_first_receiver().value);
-      poolstable pools(get_self(), get_first_receiver().value);
+      //-- get pools for this TID, only this TID's rows are visited
+      auto tidIndex = cache.poolTokenReq.get_index<name("tid")>();
+      auto itr = tidIndex.lower_bound(p_TID);
+      auto last = tidIndex.upper_bound(p_TID);
 
-      auto tidIndex = tblPoolTokenReqs.get_index<name("tid")>();
-      auto itr = tidIndex.find(p_TID);
+      //-- escrow pays out the legs below, checked once against the running total
+      escBlnc = cache.projected(escrow);
+      escBlnc.amount -= req.feesTokens.amount;
+      int64_t escrowOut = 0;
       
       //-- send total tokens for each pool with reward
-      for (; itr != tidIndex.end(); itr++)
+      for (; itr != last; itr++)
       {
-         //-- check if p_TID records
-         if(itr->TID == p_TID) {
-            auto poolItr = pools.find(itr->poolID);
-            
-            escBlnc = token::get_balance(get_self(), m_escrow, symbol_code(m_symbol));
-            check( escBlnc.amount >= (itr->rewardTokens.amount + itr->totalTokens.amount), "Insufficient escrow balance in reward distribution." );
-            
-            token::transfer2Esc( name(m_escrow), name(poolItr->rewardAcnt), asset(itr->rewardTokens.amount, symbol(m_symbol,4)), "Transfer rewards from escrow to reward accnt.");
-            token::transfer2Esc( name(m_escrow), name(itr->pool), asset(itr->totalTokens.amount, symbol(m_symbol,4)), "Transfer tokens from escrow to pool.");
+         const auto& pool = cache.getpool(itr->poolID);
 
-            //-- update owner available reward amount
-            pools.modify(poolItr, get_self(), [&]( auto& row ) {
-               row.ownerAvlblReward.amount = row.ownerAvlblReward.amount + itr->ownerRewardTokens.amount;
-            });
-         }
+         escrowOut += itr->rewardTokens.amount + itr->totalTokens.amount;
+         
+         internalleg(cache, escrow, name(pool.rewardAcnt), itr->rewardTokens.amount);
+         internalleg(cache, escrow, name(itr->pool), itr->totalTokens.amount);
+
+         //-- update owner available reward amount, holders' share accrues on all tokens lent to the pool
+         auto& poolRow = cache.modpool(itr->poolID);
+         poolRow.ownerAvlblReward.amount = poolRow.ownerAvlblReward.amount + itr->ownerRewardTokens.amount;
+         creditholders(poolRow, bpsamount(itr->rewardTokens.amount, poolRow.holderShare));
       }
 
+      check( escBlnc.amount >= escrowOut, "Insufficient escrow balance in reward distribution." );
 
-      //-- update poolsholders' remaining blnc and rewards
-      holderTknReqs holdrTknReqs (get_self(), get_first_receiver().value);
-      poolholders holders(get_self(), get_first_receiver().value);
-      
-      auto tidHldrIndex = holdrTknReqs.get_index<name("tid")>();
-      auto itrHldr = tidHldrIndex.find(p_TID);
-      
-      for (; itrHldr != tidHldrIndex.end(); itrHldr++)
-      {
-         //-- run if p_TID records 
-         if(itrHldr->TID == p_TID) 
-         {
-            auto hldrTblItr = holders.find(itrHldr->holderID);
-            
-            holders.modify(hldrTblItr, get_self(), [&]( auto& row ) {
-               // row.remainingTokens.amount = row.remainingTokens.amount + itrHldr->tokens.amount;
-               row.availableReward.amount = row.availableReward.amount + itrHldr->rewardTokens.amount;
-            });
-         }
-      }
+      logev(m_evSettled, p_TID, name(), req.hotel, req.totalTokens.amount, req.rewardTokens.amount, req.feesTokens.amount);
+
+
+      //-- poolholders' rewards were credited to their pools' reward per token above
    }
 
 
    void token::wtdrwtknhldr(const name holder, const name pool)
    {
       require_auth( holder );
+      chkmigratev2();
 
       poolholders holders (get_self(), get_first_receiver().value);
       poolstable pools(get_self(), get_first_receiver().value);
 
 
-      for(auto& item : holders)
-      {
-         if(item.poolName == pool && item.holder == holder) 
-         {
-            //-- check holder's reward
-            check ( item.availableReward.amount > 0, "Reward balance equal to zero." );
+      auto hldrIndex = holders.get_index<name("holderpool")>();
+      auto itr = hldrIndex.find(hldrpoolkey(holder, pool));
 
-            //-- get holder's reward account
-            auto poolIndex = pools.get_index<name("poolname")>();
-            auto itrPool = poolIndex.find(item.poolName.value);
+      if (itr == hldrIndex.end()) {
+         return;
+      }
 
-            //-- transfer and update holder available reward
-            token::transfer2Esc(name(itrPool->rewardAcnt), holder, item.availableReward, "-");
+      //-- release expired locks first, the unlock timer may not have run yet
+      reclaimholder(holders, itr->ID, cfg().lazyUnlockRows);
 
-            auto hldrItr = holders.find(item.ID);
-            holders.modify(hldrItr, get_self(), [&]( auto& row ) {
-               row.availableReward = m_zeroTokens;
-            });
+      //-- get holder's reward account
+      auto poolIndex = pools.get_index<name("poolname")>();
+      auto itrPool = poolIndex.find(itr->poolName.value);
 
-            break;
-         }
-      }
+      //-- check holder's reward
+      asset reward = tknasset(hldrreward(*itrPool, *itr));
+      check ( reward.amount > 0, "Reward balance equal to zero." );
+
+      //-- transfer and update holder available reward
+      token::transfer2Esc(name(itrPool->rewardAcnt), holder, reward, "-");
+
+      auto hldrItr = holders.find(itr->ID);
+      holders.modify(hldrItr, get_self(), [&]( auto& row ) {
+         row.availableReward = 0;
+         row.rewardCheckpoint = itrPool->rewardPerToken;
+      });
+
+      paidhldrrwd(itrPool->ID, reward.amount);
+
+      logev(m_evHldrReward, itr->ID, itr->poolName, holder, 0, reward.amount, 0);
+      sendevents();
    }
    
    
    void token::wtdrwtknownr(const name owner)
    {
       require_auth( owner );
+      chkmigratev2();
       
       poolstable pools(get_self(), get_first_receiver().value);
-      asset zeroTokens (0, symbol(m_symbol,4));
 
       //-- get owner
       auto poolIndex = pools.get_index<name("owner")>();
@@ -1391,23 +2626,27 @@ namespace eosio {
             
             //-- transfer and update owner available reward
             token::transfer2Esc(name(itrPool->rewardAcnt), name(itrPool->ownerAcnt), itrPool->ownerAvlblReward, "-");
+            logev(m_evOwnrReward, itrPool->ID, itrPool->poolName, owner, 0, itrPool->ownerAvlblReward.amount, 0);
 
             auto poolItr = pools.find(itrPool->ID);
 
             pools.modify(poolItr, get_self(), [&]( auto& row ) {
-               row.ownerAvlblReward = zeroTokens;
+               row.ownerAvlblReward = m_zeroTokens;
             });
          }
       }
+
+      sendevents();
    }
 
-   void token::payrewards(const name pool, const name owner)
+   void token::payrewards(const name pool, const name owner, const uint64_t cursor, const uint32_t limit)
    {
       require_auth( owner );
+      check( limit > 0, "limit must be positive." );
+      chkmigratev2();
 
       poolholders holders (get_self(), get_first_receiver().value);
       poolstable pools(get_self(), get_first_receiver().value);
-      asset zeroTokens (0, symbol(m_symbol,4));
 
       //-- get holder
       auto poolIndex = pools.get_index<name("poolname")>();
@@ -1419,41 +2658,112 @@ namespace eosio {
       check(itrPool->ownerAcnt == owner, "Invalid owner.");
 
       //-- transfer and update owner available reward
-      token::transfer2Esc(name(itrPool->rewardAcnt), itrPool->ownerAcnt, itrPool->ownerAvlblReward, "reward to owner");
-      
-      auto pItr = pools.find(itrPool->ID);
-      pools.modify(pItr, get_self(), [&]( auto& row ) {
-         row.ownerAvlblReward = zeroTokens;
-      });
+      if (itrPool->ownerAvlblReward.amount > 0) {
+         token::transfer2Esc(name(itrPool->rewardAcnt), itrPool->ownerAcnt, itrPool->ownerAvlblReward, "reward to owner");
+         logev(m_evOwnrReward, itrPool->ID, pool, itrPool->ownerAcnt, 0, itrPool->ownerAvlblReward.amount, 0);
+         
+         auto pItr = pools.find(itrPool->ID);
+         pools.modify(pItr, get_self(), [&]( auto& row ) {
+            row.ownerAvlblReward = m_zeroTokens;
+         });
+      }
 
-      //-- send reward tokens for each holder
-      for(auto& item : holders) 
+      //-- send reward tokens for at most `limit` holders of this pool, starting at holder ID `cursor`
+      auto hldrIndex = holders.get_index<name("poolid")>();
+      auto hldrItr = hldrIndex.lower_bound(hldrpoolidkey(pool, cursor));
+      uint32_t count = 0;
+      int64_t rewardsPaid = 0;
+
+      for (; hldrItr != hldrIndex.end() && hldrItr->poolName == pool && count < limit; hldrItr++, count++)
       {
-         if( item.poolName == pool )
+         asset reward = tknasset(hldrreward(*itrPool, *hldrItr));
+
+         if( reward.amount > 0 )
          {
-            if( item.availableReward.amount > 0 )
-            {
-               //-- transfer and update holder available reward
-               token::transfer2Esc(name(itrPool->rewardAcnt), name(item.holder), item.availableReward, "reward to holder");
-
-               auto hldrItr = holders.find(item.ID);
-               holders.modify(hldrItr, get_self(), [&]( auto& row ) {
-                  row.availableReward = zeroTokens;
-               });
-            }
+            rewardsPaid += reward.amount;
+
+            //-- transfer and update holder available reward
+            token::transfer2Esc(name(itrPool->rewardAcnt), name(hldrItr->holder), reward, "reward to holder");
+            logev(m_evHldrReward, hldrItr->ID, pool, hldrItr->holder, 0, reward.amount, 0);
+
+            auto itrHldr = holders.find(hldrItr->ID);
+            holders.modify(itrHldr, get_self(), [&]( auto& row ) {
+               row.availableReward = 0;
+               row.rewardCheckpoint = itrPool->rewardPerToken;
+            });
          }
       }
+
+      paidhldrrwd(itrPool->ID, rewardsPaid);
+      sendevents();
+
+      //-- cursor for the next call
+      if (hldrItr == hldrIndex.end() || hldrItr->poolName != pool) {
+         print(" payrewards done ");
+      }
+      else {
+         print(" next ", hldrItr->ID);
+      }
    }
    
    
    //-- (private)
-   void token::updpoltottkn(const name& poolName, const uint64_t& poolID, const asset& tokens, const bool& increment)
+   void token::creditholders(pool& pool, const int64_t rewardAmount) const
+   {
+      if (rewardAmount <= 0) {
+         return;
+      }
+
+      //-- no tokens lent to the pool, reward stays with the owner
+      if (pool.totalTokens.amount <= 0) {
+         pool.ownerAvlblReward.amount += rewardAmount;
+         return;
+      }
+
+      pool.rewardPerToken += (uint128_t(rewardAmount) * m_rewardScale) / uint64_t(pool.totalTokens.amount);
+      pool.hldrRewards += rewardAmount;
+   }
+
+   //-- (private)
+   int64_t token::hldrreward(const pool& pool, const poolholder& holder) const
+   {
+      auto pending = (uint128_t(holder.tokens) * (pool.rewardPerToken - holder.rewardCheckpoint)) / m_rewardScale;
+
+      return holder.availableReward + static_cast<int64_t>(pending);
+   }
+
+   //-- (private)
+   int64_t token::hldrlocked(const pool& pool, const poolholder& holder) const
+   {
+      //-- pro-rata pools lock the same share of every holder's tokens
+      if (pool.holderPolicy == m_plcyProRata)
+      {
+         if (pool.totalTokens.amount <= 0 || holder.tokens <= 0) {
+            return 0;
+         }
+
+         auto lockedTokens = pool.totalTokens.amount - pool.avlblTokens.amount;
+         return static_cast<int64_t>( (int128_t{holder.tokens} * lockedTokens + pool.totalTokens.amount - 1) / pool.totalTokens.amount );
+      }
+
+      return holder.tokens - holder.remainingTokens;
+   }
+
+   //-- (private)
+   void token::accruereward(const pool& pool, poolholder& holder) const
+   {
+      holder.availableReward = hldrreward(pool, holder);
+      holder.rewardCheckpoint = pool.rewardPerToken;
+   }
+
+
+   //-- (private)
+   void token::updpoltottkn(const uint64_t& poolID, const asset& tokens, const bool& increment, const int32_t holders, const int64_t rewardsPaid)
    {
       poolstable pools(get_self(), get_first_receiver().value);
       uint64_t totalTokens;
       uint64_t avlblTokens;
 
-      auto blncPool = token::get_balance(get_self(), poolName, symbol_code(m_symbol));
       auto poolItr = pools.find(poolID);
       
       if (increment) {
@@ -1468,6 +2778,23 @@ namespace eosio {
       pools.modify(poolItr, get_self(), [&]( auto& row ) {
          row.totalTokens.amount = totalTokens;
          row.avlblTokens.amount = avlblTokens;
+         row.activeHolders += holders;
+         row.hldrRewards -= rewardsPaid;
+      });
+   }
+
+   //-- (private) holder rewards paid out of the pool's reward account
+   void token::paidhldrrwd(const uint64_t poolID, const int64_t rewardsPaid)
+   {
+      if (rewardsPaid <= 0) {
+         return;
+      }
+
+      poolstable pools(get_self(), get_first_receiver().value);
+      auto poolItr = pools.find(poolID);
+
+      pools.modify(poolItr, get_self(), [&]( auto& row ) {
+         row.hldrRewards -= rewardsPaid;
       });
    }
 